@@ -16,9 +16,10 @@ const int kCanvasWidth = kNumBlocksX * kBlockWidth + 2 * kGapWidth;
 const int kCanvasHeight = kGapHeight + kNumBlocksY * kBlockHeight + kGapBar + kBarHeight + kBarFloat;
 const int kBarY = kCanvasHeight - kBarFloat - kBarHeight;
 
-const int kFrameRate = 60;              // frames / sec
 const int kBarSpeed = kCanvasWidth / 2; // pixels / sec
 const int kBallSpeed = kBarSpeed * 0.95;
+// 1フレームで進める最大の時間（sec）。長く止まった後にボールがブロックをすり抜けないようにする
+const double kMaxFrameTime = 0.05;
 
 array<bitset<kNumBlocksX>, kNumBlocksY> g_blocks;
 
@@ -76,11 +77,14 @@ extern "C" void main(int argc, char** arv) {
     const int kBallX = kCanvasWidth / 2 - kBallRadius - 20;
     const int kBallY = kCanvasHeight - kBarFloat - kBarHeight - kBallRadius - 20;
 
-    int bar_x = kCanvasWidth / 2 - kBarWidth / 2;
-    int ball_x = kBallX, ball_y = kBallY;
+    // 1フレームで動く距離は経過時間で変わるので、位置は画素未満の端数も持つ
+    double bar_x = kCanvasWidth / 2 - kBarWidth / 2;
+    double ball_x = kBallX, ball_y = kBallY;
     int move_dir = 0; // -1: left, 1: right, 0: stop
     int ball_dir = 0; // degree
-    int ball_dx = 0, ball_dy = 0;
+    // 前のフレームが画面に反映された時刻（nsec）。0なら未反映
+    unsigned long prev_frame_ns = 0;
+    double dt = 0; // 前のフレームからの経過時間（sec）
 
     while (true) { // main loop
         // 画面全体をクリア
@@ -88,26 +92,24 @@ extern "C" void main(int argc, char** arv) {
 
         // 各オブジェクト描画
         DrawBlocks(layer_id | LAYER_NO_REDRAW);
-        DrawBar(layer_id | LAYER_NO_REDRAW, bar_x);
+        DrawBar(layer_id | LAYER_NO_REDRAW, static_cast<int>(bar_x));
         // ボールが画面外（上方向）にぶっとんでいない場合
         if (ball_y >= 0) {
-            DrawBall(layer_id | LAYER_NO_REDRAW, ball_x, ball_y);
+            DrawBall(layer_id | LAYER_NO_REDRAW, static_cast<int>(ball_x), static_cast<int>(ball_y));
         }
         SyscallWinRedraw(layer_id);
-
-        static unsigned long prev_timeout = 0;
-        if (prev_timeout == 0) {
-            const auto timeout = SyscallCreateTimer(TIMER_ONESHOT_REL, 1, 1000 / kFrameRate);
-            prev_timeout = timeout.value;
-        } else {
-            prev_timeout += 1000 / kFrameRate;
-            SyscallCreateTimer(TIMER_ONESHOT_ABS, 1, prev_timeout);
-        }
+        // 描いたフレームが画面に反映されたら、次のフレームに進む
+        SyscallWinRequestFrame(layer_id);
 
         AppEvent events[1];
         while (true) { // event loop
             SyscallReadEvent(events, 1);
-            if (events[0].type == AppEvent::kTimerTimeout) {
+            if (events[0].type == AppEvent::kFrame) {
+                // 反映された時刻の差から、このフレームで進める時間を決める
+                const unsigned long frame_ns = events[0].arg.frame.time_ns;
+                dt = prev_frame_ns ? (frame_ns - prev_frame_ns) / 1e9 : 0;
+                dt = LimitRange(dt, 0.0, kMaxFrameTime);
+                prev_frame_ns = frame_ns;
                 break;
             } else if (events[0].type == AppEvent::kQuit) {
                 goto fin;
@@ -138,14 +140,17 @@ extern "C" void main(int argc, char** arv) {
             }
         } // event loop
 
-        bar_x += move_dir * kBarSpeed / kFrameRate;
-        bar_x = LimitRange(bar_x, 0, kCanvasWidth - kBarWidth - 1);
+        bar_x += move_dir * kBarSpeed * dt;
+        bar_x = LimitRange(bar_x, 0.0, static_cast<double>(kCanvasWidth - kBarWidth - 1));
 
         if (ball_dir == 0) { // game over
             continue;
         }
 
-        int ball_x_ = ball_x + ball_dx, ball_y_ = ball_y + ball_dy;
+        // 今の向きで dt 秒進んだ位置で衝突を調べる
+        double ball_dx = kBallSpeed * cos(M_PI * ball_dir / 180) * dt;
+        double ball_dy = kBallSpeed * sin(M_PI * ball_dir / 180) * dt;
+        const double ball_x_ = ball_x + ball_dx, ball_y_ = ball_y + ball_dy;
         // 壁にボールがぶつかる
         if ((ball_dx < 0 && ball_x_ < kBallRadius) || (ball_dx > 0 && kCanvasWidth - kBallRadius <= ball_x_)) {
             ball_dir = 180 - ball_dir;
@@ -170,8 +175,8 @@ extern "C" void main(int argc, char** arv) {
                 break;
             }
 
-            const int index_x = (ball_x_ - kGapWidth) / kBlockWidth;
-            const int index_y = (ball_y_ - kGapHeight) / kBlockHeight;
+            const int index_x = static_cast<int>(ball_x_ - kGapWidth) / kBlockWidth;
+            const int index_y = static_cast<int>(ball_y_ - kGapHeight) / kBlockHeight;
             // ブロックがない
             if (!g_blocks[index_y].test(index_x)) {
                 break;
@@ -194,8 +199,8 @@ extern "C" void main(int argc, char** arv) {
             }
         } while (false);
 
-        ball_dx = round(kBallSpeed * cos(M_PI * ball_dir / 180) / kFrameRate);
-        ball_dy = round(kBallSpeed * sin(M_PI * ball_dir / 180) / kFrameRate);
+        ball_dx = kBallSpeed * cos(M_PI * ball_dir / 180) * dt;
+        ball_dy = kBallSpeed * sin(M_PI * ball_dir / 180) * dt;
         ball_x += ball_dx;
         ball_y += ball_dy;
     } // main loop
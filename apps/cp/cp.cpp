@@ -1,5 +1,8 @@
 #include <cstdio>
 #include <cstdlib>
+#include <fcntl.h>
+
+#include "../syscall.h"
 
 extern "C" void main(int argc, char** argv) {
     if (argc < 3) {
@@ -7,26 +10,23 @@ extern "C" void main(int argc, char** argv) {
         exit(1);
     }
 
-    FILE* fp_src = fopen(argv[1], "r");
-    if (fp_src == nullptr) {
+    const int fd_src = open(argv[1], O_RDONLY);
+    if (fd_src < 0) {
         printf("failed to open for read: %s\n", argv[1]);
         exit(1);
     }
 
-    FILE* fp_dest = fopen(argv[2], "w");
-    if (fp_dest == nullptr) {
+    const int fd_dest = open(argv[2], O_WRONLY | O_CREAT);
+    if (fd_dest < 0) {
         printf("failed to open for write: %s\n", argv[2]);
         exit(1);
     }
 
-    char buf[256];
-    size_t bytes;
-    while ((bytes = fread(buf, 1, sizeof(buf), fp_src)) > 0) {
-        const size_t written = fwrite(buf, 1, bytes, fp_dest);
-        if (bytes != written) {
-            printf("failed to write to %s\n", argv[2]);
-            exit(1);
-        }
+    // カーネル内でファイルからファイルへ直接コピーする
+    auto [bytes, err] = SyscallSplice(fd_dest, fd_src, SIZE_MAX);
+    if (err) {
+        printf("failed to write to %s\n", argv[2]);
+        exit(1);
     }
     exit(0);
 }
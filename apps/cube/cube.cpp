@@ -1,6 +1,9 @@
 #include <array>
 #include <cmath>
+#include <cstdio>
 #include <cstdlib>
+#include <ctime>
+#include <sys/time.h>
 
 #include "../syscall.h"
 
@@ -71,7 +74,13 @@ extern "C" void main(int argc, char** argv) {
 
     int thx = 0, thy = 0, thz = 0;
     const double to_rad = 3.14159265358979323 / 0x8000;
+    // 1フレームの描画にかかった時間の合計（usec）
+    long draw_us_total = 0;
+    int num_frames = 0;
     while (true) {
+        timeval frame_start;
+        gettimeofday(&frame_start, nullptr);
+
         // 立方体をx,y,z軸回りに回転
         thx = (thx + 182) & 0xffff;
         thy = (thy + 273) & 0xffff;
@@ -101,12 +110,21 @@ extern "C" void main(int argc, char** argv) {
         SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW, 4, 24, kCanvasSize, kCanvasSize, 0);
         DrawObj(layer_id | LAYER_NO_REDRAW);
         SyscallWinRedraw(layer_id);
+
+        timeval frame_end;
+        gettimeofday(&frame_end, nullptr);
+        draw_us_total += (frame_end.tv_sec - frame_start.tv_sec) * 1000000 + (frame_end.tv_usec - frame_start.tv_usec);
+        num_frames++;
+
         if (Sleep(50)) {
             break;
         }
     }
 
     SyscallCloseWindow(layer_id);
+    if (num_frames > 0) {
+        printf("average draw time: %ld us/frame\n", draw_us_total / num_frames);
+    }
     exit(0);
 }
 
@@ -183,21 +201,32 @@ void DrawSurface(uint64_t layer_id, int sur) {
 }
 
 bool Sleep(unsigned long ms) {
-    static unsigned long prev_timeout = 0;
-    if (prev_timeout == 0) {
-        const auto timeout = SyscallCreateTimer(TIMER_ONESHOT_REL, 1, ms);
-        prev_timeout = timeout.value;
-    } else {
-        prev_timeout += ms;
-        SyscallCreateTimer(TIMER_ONESHOT_ABS, 1, prev_timeout);
+    // 前回のフレームの開始から ms ミリ秒後まで、イベントを待ちながら眠る
+    static uint64_t next_frame_ns = 0;
+    timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    const uint64_t now_ns = static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    if (next_frame_ns == 0 || next_frame_ns + ms * 1000000 < now_ns) {
+        next_frame_ns = now_ns;
     }
+    next_frame_ns += ms * 1000000;
 
-    AppEvent events[1];
     while (true) {
-        SyscallReadEvent(events, 1);
-        if (events[0].type == AppEvent::kTimerTimeout) {
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        const uint64_t t = static_cast<uint64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+        if (t >= next_frame_ns) {
             return false;
-        } else if (events[0].type == AppEvent::kQuit) {
+        }
+
+        PollFd pfd{POLL_EVENT_FD, POLL_READABLE, 0};
+        auto [num_ready, err] = SyscallPoll(&pfd, 1, (next_frame_ns - t + 999999) / 1000000);
+        if (err || num_ready == 0) {
+            continue;
+        }
+
+        AppEvent events[1];
+        SyscallReadEvent(events, 1);
+        if (events[0].type == AppEvent::kQuit) {
             return true;
         }
     }
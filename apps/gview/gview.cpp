@@ -54,6 +54,14 @@ uint32_t GetColorGray(unsigned char* image_data) {
     return gray << 16 | gray << 8 | gray;
 }
 
+/// 0xRRGGBB 形式の色を、描画領域の画素形式（不透明）に変換する
+uint32_t EncodeColor(int format, uint32_t rgb) {
+    if (format == WIN_SURFACE_RGB) {
+        rgb = (rgb & 0x00ff00) | (rgb >> 16 & 0xff) | (rgb & 0xff) << 16;
+    }
+    return 0xff000000 | rgb;
+}
+
 extern "C" void main(int argc, char** argv) {
     if (argc < 2) {
         fprintf(stderr, "Usage: %s <file>\n", argv[0]);
@@ -85,15 +93,21 @@ extern "C" void main(int argc, char** argv) {
     }
     const uint64_t layer_id = window.value;
 
+    // ウィンドウの描画領域に直接書き込み、書き込んだ範囲だけを再描画させる
+    WinSurface surface;
+    SyscallResult res = SyscallWinMapSurface(layer_id, &surface);
+    if (res.error) {
+        fprintf(stderr, "WinMapSurface failed: %s\n", strerror(res.error));
+        exit(1);
+    }
     for (int y = 0; y < height; y++) {
+        uint32_t* row = &surface.pixels[(24 + y) * surface.stride + 4];
         for (int x = 0; x < width; x++) {
-            uint32_t c = get_color(&image_data[bytes_per_pixel * (y * width + x)]);
-            SyscallWinFillRectangle(layer_id | LAYER_NO_REDRAW,
-                                    4 + x, 24 + y, 1, 1, c);
+            row[x] = EncodeColor(surface.format, get_color(&image_data[bytes_per_pixel * (y * width + x)]));
         }
     }
+    SyscallWinRedrawArea(layer_id, 4, 24, width, height);
 
-    SyscallWinRedraw(layer_id);
     WaitEvent();
 
     SyscallCloseWindow(layer_id);
@@ -0,0 +1,55 @@
+/// 要求・完了リングを使うための補助関数
+/// 要求を IoRingGetSqe() で得て書き込み、IoRingCommit() で確定し、IoRingSubmit() でまとめて処理させる
+/// 1つのリングを複数のスレッドから使う場合は、呼び出し側で排他すること
+
+#pragma once
+
+#include "../kernel/io_ring.hpp"
+#include "syscall.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 確定済みでまだ処理されていない要求をすべて処理させる
+static inline struct SyscallResult IoRingSubmit(struct IoRing* ring) {
+    return SyscallIoRingEnter(ring->sq_tail - ring->sq_head);
+}
+
+/// 次に書き込む要求の領域を得る。要求リングが満杯ならいったん処理させる
+/// 完了リングが満杯で処理が進まなければ NULL
+static inline struct IoRingSqe* IoRingGetSqe(struct IoRing* ring) {
+    if (ring->sq_tail - ring->sq_head >= IO_RING_SQ_ENTRIES) {
+        IoRingSubmit(ring);
+        if (ring->sq_tail - ring->sq_head >= IO_RING_SQ_ENTRIES) {
+            return NULL;
+        }
+    }
+    struct IoRingSqe* sqe = &ring->sqes[ring->sq_tail % IO_RING_SQ_ENTRIES];
+    sqe->flags = 0;
+    sqe->user_data = 0;
+    return sqe;
+}
+
+/// IoRingGetSqe() で得た要求を確定する
+static inline void IoRingCommit(struct IoRing* ring) {
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    ring->sq_tail++;
+}
+
+/// 最も古い完了通知。なければ NULL
+static inline struct IoRingCqe* IoRingPeekCqe(struct IoRing* ring) {
+    if (ring->cq_head == ring->cq_tail) {
+        return NULL;
+    }
+    return &ring->cqes[ring->cq_head % IO_RING_CQ_ENTRIES];
+}
+
+/// IoRingPeekCqe() で得た完了通知を処理済みにする
+static inline void IoRingSeenCqe(struct IoRing* ring) {
+    ring->cq_head++;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
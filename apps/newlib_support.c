@@ -1,11 +1,40 @@
 #include <errno.h>
+#include <limits.h>
 #include <signal.h>
 #include <stdint.h>
 #include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/time.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include "syscall.h"
+#include "thread.h"
+#include "../kernel/time_page.hpp"
+
+#ifndef CLOCK_REALTIME
+#define CLOCK_REALTIME 1
+#endif
+#ifndef CLOCK_MONOTONIC
+#define CLOCK_MONOTONIC 4
+#endif
+
+/// 時刻情報ページから起動からの経過時間（ナノ秒）を得る
+/// システムコールを発行しないので、高頻度で呼び出しても軽い
+static uint64_t NowNanoseconds(void) {
+    return TimePageNanoseconds((const struct TimePage*)TIME_PAGE_ADDR);
+}
+
+int clock_gettime(clockid_t clock_id, struct timespec* tp) {
+    if (clock_id != CLOCK_REALTIME && clock_id != CLOCK_MONOTONIC) {
+        errno = EINVAL;
+        return -1;
+    }
+    const uint64_t ns = NowNanoseconds();
+    tp->tv_sec = ns / 1000000000;
+    tp->tv_nsec = ns % 1000000000;
+    return 0;
+}
 
 int close(int fd) {
     errno = EBADF;
@@ -17,6 +46,14 @@ int fstat(int fd, struct stat* buf) {
     return -1;
 }
 
+/// 日時は取得できないので、起動からの経過時間を返す
+int gettimeofday(struct timeval* tv, void* tz) {
+    const uint64_t ns = NowNanoseconds();
+    tv->tv_sec = ns / 1000000000;
+    tv->tv_usec = ns % 1000000000 / 1000;
+    return 0;
+}
+
 pid_t getpid(void) {
     return 0;
 }
@@ -100,4 +137,168 @@ ssize_t write(int fd, const void* buf, size_t count) {
 
 void _exit(int status) {
     SyscallExit(status);
-}
\ No newline at end of file
+}
+
+/// スレッドの開始関数とその引数
+struct ThreadStart {
+    int (*func)(void*);
+    void* arg;
+};
+
+/// カーネルが新しいスレッドで最初に呼び出す関数
+static void ThreadEntry(int unused, void* data) {
+    struct ThreadStart start = *(struct ThreadStart*)data;
+    free(data);
+    thread_exit(start.func(start.arg));
+}
+
+int thread_create(uint64_t* tid, int (*func)(void*), void* arg) {
+    struct ThreadStart* start = malloc(sizeof(struct ThreadStart));
+    if (start == NULL) {
+        return ENOMEM;
+    }
+    start->func = func;
+    start->arg = arg;
+
+    struct SyscallResult res = SyscallCreateThread(ThreadEntry, start);
+    if (res.error) {
+        free(start);
+        return res.error;
+    }
+    *tid = res.value;
+    return 0;
+}
+
+int thread_join(uint64_t tid, int* exit_code) {
+    struct SyscallResult res = SyscallJoinThread(tid);
+    if (res.error) {
+        return res.error;
+    }
+    if (exit_code) {
+        *exit_code = (int)res.value;
+    }
+    return 0;
+}
+
+void thread_exit(int exit_code) {
+    SyscallExitThread(exit_code);
+    while (1) {}
+}
+
+uint64_t thread_self(void) {
+    // TCB の2番目の要素がスレッドID
+    uint64_t tid;
+    __asm__ volatile("mov %%fs:8, %0" : "=r"(tid));
+    return tid;
+}
+
+void thread_mutex_lock(thread_mutex_t* mutex) {
+    uint32_t c = 0;
+    if (__atomic_compare_exchange_n(&mutex->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return;
+    }
+    // 競合したので、待っているスレッドがいる印（2）を付けてから眠る
+    if (c != 2) {
+        c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+    }
+    while (c != 0) {
+        SyscallFutexWait(&mutex->state, 2, FUTEX_NO_TIMEOUT);
+        c = __atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE);
+    }
+}
+
+int thread_mutex_trylock(thread_mutex_t* mutex) {
+    uint32_t c = 0;
+    if (__atomic_compare_exchange_n(&mutex->state, &c, 1, 0, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+        return 0;
+    }
+    return EBUSY;
+}
+
+void thread_mutex_unlock(thread_mutex_t* mutex) {
+    if (__atomic_exchange_n(&mutex->state, 0, __ATOMIC_RELEASE) == 2) {
+        SyscallFutexWake(&mutex->state, 1);
+    }
+}
+
+/// 条件変数で起こされた後の獲得
+/// 他にも待っているスレッドがいるかもしれないので、常に印（2）を付けて獲得する
+static void RelockAfterWait(thread_mutex_t* mutex) {
+    while (__atomic_exchange_n(&mutex->state, 2, __ATOMIC_ACQUIRE) != 0) {
+        SyscallFutexWait(&mutex->state, 2, FUTEX_NO_TIMEOUT);
+    }
+}
+
+int thread_cond_timedwait(thread_cond_t* cond, thread_mutex_t* mutex, uint64_t timeout_ms) {
+    // 解放する前の値で眠れば、解放後の通知を取りこぼさない
+    const uint32_t seq = __atomic_load_n(&cond->seq, __ATOMIC_RELAXED);
+    thread_mutex_unlock(mutex);
+    struct SyscallResult res = SyscallFutexWait(&cond->seq, seq, timeout_ms);
+    RelockAfterWait(mutex);
+    return res.error == ETIMEDOUT ? ETIMEDOUT : 0;
+}
+
+void thread_cond_wait(thread_cond_t* cond, thread_mutex_t* mutex) {
+    thread_cond_timedwait(cond, mutex, FUTEX_NO_TIMEOUT);
+}
+
+void thread_cond_signal(thread_cond_t* cond) {
+    __atomic_fetch_add(&cond->seq, 1, __ATOMIC_RELEASE);
+    SyscallFutexWake(&cond->seq, 1);
+}
+
+void thread_cond_broadcast(thread_cond_t* cond) {
+    __atomic_fetch_add(&cond->seq, 1, __ATOMIC_RELEASE);
+    SyscallFutexWake(&cond->seq, INT_MAX);
+}
+
+int thread_sem_trywait(thread_sem_t* sem) {
+    uint32_t v = __atomic_load_n(&sem->value, __ATOMIC_RELAXED);
+    while (v > 0) {
+        if (__atomic_compare_exchange_n(&sem->value, &v, v - 1, 1, __ATOMIC_ACQUIRE, __ATOMIC_RELAXED)) {
+            return 0;
+        }
+    }
+    return EAGAIN;
+}
+
+void thread_sem_wait(thread_sem_t* sem) {
+    while (thread_sem_trywait(sem) != 0) {
+        __atomic_fetch_add(&sem->waiters, 1, __ATOMIC_SEQ_CST);
+        SyscallFutexWait(&sem->value, 0, FUTEX_NO_TIMEOUT);
+        __atomic_fetch_sub(&sem->waiters, 1, __ATOMIC_RELAXED);
+    }
+}
+
+void thread_sem_post(thread_sem_t* sem) {
+    __atomic_fetch_add(&sem->value, 1, __ATOMIC_SEQ_CST);
+    if (__atomic_load_n(&sem->waiters, __ATOMIC_SEQ_CST) > 0) {
+        SyscallFutexWake(&sem->value, 1);
+    }
+}
+
+struct _reent;
+
+/// newlib の malloc が使うロック（同じスレッドから再帰的に獲得される）
+static thread_mutex_t malloc_mutex = THREAD_MUTEX_INITIALIZER;
+static uint64_t malloc_owner;
+static int malloc_depth;
+
+void __malloc_lock(struct _reent* r) {
+    const uint64_t self = thread_self();
+    if (__atomic_load_n(&malloc_owner, __ATOMIC_RELAXED) == self) {
+        malloc_depth++;
+        return;
+    }
+    thread_mutex_lock(&malloc_mutex);
+    __atomic_store_n(&malloc_owner, self, __ATOMIC_RELAXED);
+    malloc_depth = 1;
+}
+
+void __malloc_unlock(struct _reent* r) {
+    if (--malloc_depth > 0) {
+        return;
+    }
+    __atomic_store_n(&malloc_owner, 0, __ATOMIC_RELAXED);
+    thread_mutex_unlock(&malloc_mutex);
+}
@@ -1,5 +1,6 @@
 #include <cstdlib>
 #include <random>
+#include <sys/time.h>
 
 #include "../syscall.h"
 
@@ -19,7 +20,8 @@ extern "C" void main(int argc, char** argv) {
         num_stars = atoi(argv[1]);
     }
 
-    auto [tick_start, timer_freq] = SyscallGetCurrentTick();
+    timeval time_start;
+    gettimeofday(&time_start, nullptr);
 
     std::default_random_engine rand_engine;
     // [0, kWidth - 2], [0, kHeight - 2]の範囲で乱数を生成
@@ -32,9 +34,11 @@ extern "C" void main(int argc, char** argv) {
     }
     SyscallWinRedraw(layer_id);
 
-    auto tick_end = SyscallGetCurrentTick();
-    // ms変換して表示
-    printf("%d stars in %lu ms.\n", num_stars, (tick_end.value - tick_start) * 1000 / timer_freq);
+    timeval time_end;
+    gettimeofday(&time_end, nullptr);
+    // usec単位で表示
+    const long elapsed_us = (time_end.tv_sec - time_start.tv_sec) * 1000000 + (time_end.tv_usec - time_start.tv_usec);
+    printf("%d stars in %ld us.\n", num_stars, elapsed_us);
 
     exit(0);
 }
\ No newline at end of file
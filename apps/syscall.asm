@@ -29,3 +29,19 @@ define_syscall OpenFile, 0x8000000c
 define_syscall ReadFile, 0x8000000d
 define_syscall DemandPages, 0x8000000e
 define_syscall MapFile, 0x8000000f
+define_syscall CancelTimer, 0x80000010
+define_syscall ClockGetTime, 0x80000011
+define_syscall GetLatencyHistogram, 0x80000012
+define_syscall CreateThread, 0x80000013
+define_syscall ExitThread, 0x80000014
+define_syscall JoinThread, 0x80000015
+define_syscall FutexWait, 0x80000016
+define_syscall FutexWake, 0x80000017
+define_syscall IoRingSetup, 0x80000018
+define_syscall IoRingEnter, 0x80000019
+define_syscall WinBlit, 0x8000001a
+define_syscall Poll, 0x8000001b
+define_syscall Splice, 0x8000001c
+define_syscall WinRequestFrame, 0x8000001d
+define_syscall WinMapSurface, 0x8000001e
+define_syscall WinRedrawArea, 0x8000001f
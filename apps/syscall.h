@@ -1,3 +1,5 @@
+#pragma once
+
 #ifdef __cplusplus
 #include <cstddef>
 #include <cstdint>
@@ -10,6 +12,8 @@ extern "C" {
 
 #include "../kernel/app_event.hpp"
 #include "../kernel/logger.hpp"
+#include "../kernel/poll.hpp"
+#include "../kernel/win_surface.hpp"
 
 struct SyscallResult {
     uint64_t value;
@@ -20,6 +24,7 @@ struct SyscallResult {
 
 struct SyscallResult SyscallLogString(enum LogLevel level, const char* message);
 struct SyscallResult SyscallPutString(uint64_t, uint64_t, uint64_t);
+/// スレッドから呼んでもアプリ全体を終了する
 void SyscallExit(int exit_code);
 struct SyscallResult SyscallOpenWindow(int w, int h, int x, int y, const char* title);
 
@@ -30,16 +35,64 @@ struct SyscallResult SyscallGetCurrentTick();
 struct SyscallResult SyscallWinRedraw(uint64_t layer_id_flags);
 struct SyscallResult SyscallWinDrawLine(uint64_t layer_id_flags, int x0, int y0, int x1, int y1, uint32_t color);
 struct SyscallResult SyscallCloseWindow(uint64_t layer_id_flags);
+/// pixels : 0x00RRGGBB 形式の画素を w×h 個並べた配列。上位8ビットは無視され、不透明として描かれる
+struct SyscallResult SyscallWinBlit(uint64_t layer_id_flags, int x, int y, int w, int h, const uint32_t* pixels);
+/// イベントはメインスレッドにだけ届く。他のスレッドから呼ぶと EINVAL
 struct SyscallResult SyscallReadEvent(struct AppEvent* events, size_t len);
+/// fds のいずれかが準備できるか timeout_ms ミリ秒経つまで待つ（-1なら無期限）
+/// fd に POLL_EVENT_FD を指定すると SyscallReadEvent() で読めるイベントを待つ（メインスレッドのみ）
+/// valueに revents が0でない要素の数が入る
+struct SyscallResult SyscallPoll(struct PollFd* fds, size_t nfds, uint64_t timeout_ms);
 
 #define TIMER_ONESHOT_REL 1
 #define TIMER_ONESHOT_ABS 0
+#define TIMER_PERIODIC 2
 struct SyscallResult SyscallCreateTimer(unsigned int type, int timer_value, unsigned long timeout_ms);
+struct SyscallResult SyscallCancelTimer(int timer_value);
+/// clock_id : newlibのCLOCK_REALTIME / CLOCK_MONOTONIC
+/// 成功するとvalueにナノ秒単位の時刻が入る
+struct SyscallResult SyscallClockGetTime(int clock_id);
+/// タスクが起床してから実行されるまでの待ち時間の分布を取得する
+/// kind : 0なら優先度別（target は優先度）、1ならタスク別（target はタスクID）
+/// counts[i] には [2^(i-1), 2^i) µs（i=0は1µs未満）の回数が入る
+#define LATENCY_BY_LEVEL 0
+#define LATENCY_BY_TASK 1
+struct SyscallResult SyscallGetLatencyHistogram(int kind, uint64_t target, uint64_t* counts, size_t len);
+/// entry(0, arg) から実行されるスレッドを作る。成功するとvalueにスレッドIDが入る
+/// entry から戻ることはできないので、最後に SyscallExitThread() を呼ぶこと
+struct SyscallResult SyscallCreateThread(void (*entry)(int, void*), void* arg);
+/// メインスレッドから呼び出すと、他のスレッドの終了を待ってからアプリを終了する
+void SyscallExitThread(int exit_code);
+/// 成功するとvalueにスレッドの終了コードが入る
+/// 他のスレッドが既に同じスレッドの終了を待っていれば EBUSY
+struct SyscallResult SyscallJoinThread(uint64_t tid);
+/// *addr が expected と等しければ、SyscallFutexWake() で起こされるまで眠る
+/// 値が異なれば EAGAIN、タイムアウトすれば ETIMEDOUT、アプリに割り当てられないアドレスなら EFAULT
+#define FUTEX_NO_TIMEOUT ((uint64_t)-1)
+struct SyscallResult SyscallFutexWait(uint32_t* addr, uint32_t expected, uint64_t timeout_ms);
+/// addr で眠っているスレッドを最大 n 個起こす。valueに起こした数が入る
+struct SyscallResult SyscallFutexWake(uint32_t* addr, int n);
+/// 要求・完了リング（io_ring.h）を作る。valueにリングのアドレスが入る
+struct SyscallResult SyscallIoRingSetup(void);
+/// 要求リングの要求を最大 to_submit 個処理させる。valueに処理した数が入る
+struct SyscallResult SyscallIoRingEnter(uint32_t to_submit);
 
 struct SyscallResult SyscallOpenFile(const char* path, int flags);
 struct SyscallResult SyscallReadFile(int fd, void* buf, size_t count);
 struct SyscallResult SyscallDemandPages(size_t num_pages, int flags);
 struct SyscallResult SyscallMapFile(int fd, size_t* file_size, int flags);
+/// fd_in から fd_out へ最大 count バイト転送する。アプリのバッファを経由しない
+/// fd_in が終端に達したら、そこで終わる。valueに転送したバイト数が入る
+struct SyscallResult SyscallSplice(int fd_out, int fd_in, size_t count);
+/// 次にフレームを画面へ反映したとき、AppEvent::kFrame を受け取るよう要求する
+/// アニメーションはこのイベントを待ってから次のフレームを描くと、画面の更新と同期する
+struct SyscallResult SyscallWinRequestFrame(uint64_t layer_id);
+/// ウィンドウの描画内容を保持する領域をアプリのアドレス空間にマップする。valueに先頭アドレスが入る
+/// surface->pixels に画素を直接書き込んだら、SyscallWinRedrawArea() で書き込んだ範囲を知らせる
+/// マップできるのはアプリ自身が開いたウィンドウだけで、それ以外は EPERM
+struct SyscallResult SyscallWinMapSurface(uint64_t layer_id, struct WinSurface* surface);
+/// ウィンドウの左上を基準とした範囲だけを再描画する
+struct SyscallResult SyscallWinRedrawArea(uint64_t layer_id, int x, int y, int w, int h);
 
 #ifdef __cplusplus
 } // extern "C"
@@ -0,0 +1,71 @@
+/// アプリのスレッド
+/// 同じアプリのスレッドはメモリとファイルディスクリプタを共有する
+/// __thread を付けた変数はスレッドごとに用意される（カーネルがFSベースを設定する）
+/// 同期機構は競合しなければシステムコールを呼ばず、競合したときだけフューテックスで眠る
+
+#pragma once
+
+#ifdef __cplusplus
+#include <cstdint>
+
+extern "C" {
+#else
+#include <stdint.h>
+#endif
+
+/// func(arg) を実行するスレッドを作り、*tid にスレッドIDを格納する
+/// func の戻り値がスレッドの終了コードになる
+/// 成功なら0、失敗ならエラー番号を返す
+int thread_create(uint64_t* tid, int (*func)(void*), void* arg);
+/// スレッドの終了を待ち、exit_code が NULL でなければ終了コードを格納する
+/// 成功なら0、失敗ならエラー番号を返す
+int thread_join(uint64_t tid, int* exit_code);
+/// 呼び出したスレッドを終了する
+/// メインスレッドから呼び出すと、他のスレッドの終了を待ってからアプリを終了する
+void thread_exit(int exit_code) __attribute__((noreturn));
+/// 呼び出したスレッドのID
+uint64_t thread_self(void);
+
+/// 相互排他ロック。0で初期化する
+/// state : 0 = 解放、1 = 獲得済み、2 = 獲得済みで待っているスレッドがいるかもしれない
+typedef struct {
+    uint32_t state;
+} thread_mutex_t;
+#define THREAD_MUTEX_INITIALIZER {0}
+
+void thread_mutex_lock(thread_mutex_t* mutex);
+/// 獲得できなければ EBUSY を返す
+int thread_mutex_trylock(thread_mutex_t* mutex);
+void thread_mutex_unlock(thread_mutex_t* mutex);
+
+/// 条件変数。0で初期化する
+typedef struct {
+    /// 通知のたびに増える値
+    uint32_t seq;
+} thread_cond_t;
+#define THREAD_COND_INITIALIZER {0}
+
+/// mutex を解放して通知を待ち、再び mutex を獲得してから戻る
+/// 通知がなくても戻ることがあるので、呼び出し側で条件を確かめ直すこと
+void thread_cond_wait(thread_cond_t* cond, thread_mutex_t* mutex);
+/// timeout_ms ミリ秒以内に通知がなければ ETIMEDOUT を返す
+int thread_cond_timedwait(thread_cond_t* cond, thread_mutex_t* mutex, uint64_t timeout_ms);
+void thread_cond_signal(thread_cond_t* cond);
+void thread_cond_broadcast(thread_cond_t* cond);
+
+/// 計数セマフォ
+typedef struct {
+    uint32_t value;
+    /// 眠っている（眠ろうとしている）スレッドの数
+    uint32_t waiters;
+} thread_sem_t;
+#define THREAD_SEM_INITIALIZER(value) {(value), 0}
+
+void thread_sem_wait(thread_sem_t* sem);
+/// 値が0なら EAGAIN を返す
+int thread_sem_trywait(thread_sem_t* sem);
+void thread_sem_post(thread_sem_t* sem);
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -12,6 +12,7 @@ struct AppEvent {
         kMouseButton,
         kTimerTimeout,
         kKeyPush,
+        kFrame,
     } type;
 
     union {
@@ -47,6 +48,16 @@ struct AppEvent {
             /// 1 : press, 0 : release
             int press;
         } keypush;
+
+        /// SyscallWinRequestFrame() で要求したフレームが画面に反映された
+        /// 次のフレームを描き始めてよい
+        struct {
+            unsigned int layer_id;
+            /// 反映した時刻（CLOCK_MONOTONIC と同じ基準のナノ秒）
+            unsigned long time_ns;
+            /// 反映したフレームの通し番号
+            unsigned long sequence;
+        } frame;
     } arg;
 };
 
@@ -152,9 +152,12 @@ SwitchContext:  ; void SwitchContext(void* next_ctx, void* current_ctx);
     mov dx, gs
     mov [rsi + 0x38], rdx
 
-    fxsave [rsi + 0xc0]
+    ; FPU/SSEレジスタはここでは保存しない
+    ; 次のタスクが初めてFPUを使ったときに #NM 例外のハンドラで保存する
     ; fall through to RestoreContext
 
+extern g_fpu_owner_ctx
+extern g_running_ctx
 global RestoreContext
 RestoreContext:  ; void RestoreContext(void* task_context);
     ; iret 用のスタックフレーム
@@ -165,7 +168,18 @@ RestoreContext:  ; void RestoreContext(void* task_context);
     push qword [rdi + 0x08] ; RIP
 
     ; コンテキストの復帰
-    fxrstor [rdi + 0xc0]
+    ; FPUの状態が次のタスクのものであればそのまま使わせ、
+    ; そうでなければCR0.TSを立てて最初にFPUを使ったときに #NM 例外を起こさせる
+    mov [g_running_ctx], rdi
+    cmp rdi, [g_fpu_owner_ctx]
+    je .fpu_owner
+    mov rax, cr0
+    or rax, 8   ; CR0.TS
+    mov cr0, rax
+    jmp .fpu_done
+.fpu_owner:
+    clts
+.fpu_done:
 
     mov rax, [rdi + 0x00]
     mov cr3, rax
@@ -173,6 +187,11 @@ RestoreContext:  ; void RestoreContext(void* task_context);
     mov fs, ax
     mov rax, [rdi + 0x38]
     mov gs, ax
+    ; スレッドローカル領域の基点。FSセレクタを読み込んだ後に設定する
+    mov ecx, 0xc0000100  ; IA32_FS_BASE
+    mov eax, [rdi + 0x2c0]
+    mov edx, [rdi + 0x2c4]
+    wrmsr
 
     mov rax, [rdi + 0x40]
     mov rbx, [rdi + 0x48]
@@ -222,7 +241,6 @@ IntHandlerLAPICTimer:  ; void IntHandlerLAPICTimer();
 
     ; スタック上に TaskContext 型の構造を構築する
     sub rsp, 512
-    fxsave [rsp]
     push r15
     push r14
     push r13
@@ -240,6 +258,16 @@ IntHandlerLAPICTimer:  ; void IntHandlerLAPICTimer();
     push rbx
     push rax
 
+    ; 割り込まれたタスクがFPUを所有している（CR0.TS == 0）場合のみ、
+    ; ハンドラ内でSSEレジスタが壊されても戻せるよう退避しておく
+    xor edx, edx
+    mov rax, cr0
+    test rax, 8  ; CR0.TS
+    jnz .fpu_not_owned
+    fxsave [rbp - 512]
+    mov edx, 1
+.fpu_not_owned:
+
     mov ax, fs
     mov bx, gs
     mov rcx, cr3
@@ -248,7 +276,7 @@ IntHandlerLAPICTimer:  ; void IntHandlerLAPICTimer();
     push rax                 ; FS
     push qword [rbp + 0x28]  ; SS
     push qword [rbp + 0x10]  ; CS
-    push rbp                 ; reserved1
+    push rdx                 ; fpu_saved
     push qword [rbp + 0x18]  ; RFLAGS
     push qword [rbp + 0x08]  ; RIP
     push rcx                 ; CR3
@@ -256,6 +284,21 @@ IntHandlerLAPICTimer:  ; void IntHandlerLAPICTimer();
     mov rdi, rsp
     call LAPICTimerOnInterrupt
 
+    ; タスクを切り替えずに戻る場合、FPUの状態を割り込み前に戻す
+    ; 退避していなければ、ハンドラ内の #NM でFPUを横取りしている可能性があるので所有権を手放す
+    cmp qword [rsp + 0x18], 0  ; fpu_saved
+    je .fpu_release
+    fxrstor [rbp - 512]
+    jmp .fpu_done
+.fpu_release:
+    mov rax, cr0
+    test rax, 8  ; CR0.TS
+    jnz .fpu_done
+    mov qword [g_fpu_owner_ctx], 0
+    or rax, 8
+    mov cr0, rax
+.fpu_done:
+
     add rsp, 8*8  ; CR3 から GS までを無視
     pop rax
     pop rbx
@@ -272,12 +315,32 @@ IntHandlerLAPICTimer:  ; void IntHandlerLAPICTimer();
     pop r13
     pop r14
     pop r15
-    fxrstor [rsp]
 
     mov rsp, rbp
     pop rbp
     iretq
 
+; void IntHandlerNM();
+; CR0.TSが立った状態でFPU/SSE命令を実行すると発生する例外のハンドラ
+; FPUの所有者の状態を保存し、実行中のタスクの状態を読み込んで所有者を交代する
+global IntHandlerNM
+IntHandlerNM:
+    push rax
+    clts
+    mov rax, [g_fpu_owner_ctx]
+    test rax, rax
+    jz .load
+    fxsave [rax + 0xc0]
+.load:
+    mov rax, [g_running_ctx]
+    mov [g_fpu_owner_ctx], rax
+    test rax, rax
+    jz .done
+    fxrstor [rax + 0xc0]
+.done:
+    pop rax
+    iretq
+
 global LoadTR
 LoadTR:  ; void LoadTR(uint16_t sel);
     ltr di
@@ -293,7 +356,37 @@ WriteMSR:  ; void WriteMSR(uint32_t msr, uint64_t value);
     wrmsr
     ret
 
-extern GetCurrentTaskOSStackPointer
+global ReadMSR
+ReadMSR:  ; uint64_t ReadMSR(uint32_t msr);
+    mov ecx, edi
+    rdmsr
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+global ReadTSC
+ReadTSC:  ; uint64_t ReadTSC();
+    rdtsc
+    shl rdx, 32
+    or rax, rdx
+    ret
+
+global CPUID
+CPUID:  ; void CPUID(uint32_t leaf, uint32_t subleaf, uint32_t* regs);
+    push rbx  ; rbx は callee-saved
+    mov r8, rdx  ; cpuid が rdx を上書きするので退避
+    mov eax, edi
+    mov ecx, esi
+    cpuid
+    mov [r8], eax
+    mov [r8 + 4], ebx
+    mov [r8 + 8], ecx
+    mov [r8 + 12], edx
+    pop rbx
+    ret
+
+extern EnterSyscall
+extern LeaveSyscall
 extern g_syscall_table
 global SyscallEntry
 SyscallEntry:  ; void SyscallEntry(void);
@@ -312,9 +405,14 @@ SyscallEntry:  ; void SyscallEntry(void);
     and rsp, 0xfffffffffffffff0
     push rax
     push rdx
+    push rdi
+    push rdi  ; 16バイト境界を保つ
+    mov edi, eax  ; システムコール番号（呼び出し回数の集計用）
     cli
-    call GetCurrentTaskOSStackPointer
+    call EnterSyscall
     sti
+    pop rdi
+    pop rdi
     mov rdx, [rsp + 0]  ; RDX
     mov [rax - 16], rdx
     mov rdx, [rsp + 8]  ; RAX
@@ -330,11 +428,26 @@ SyscallEntry:  ; void SyscallEntry(void);
     ; rbx, r12-r15 は callee-saved なので呼び出し側で保存しない
     ; rax は戻り値用なので呼び出し側で保存しない
 
-    mov rsp, rbp
-
-    pop rsi  ; システムコール番号を復帰
+    mov esi, [rbp]  ; システムコール番号
     cmp esi, 0x80000002 ; アプリ終了システムコールの番号（3番目に作成したので02とする）
     je  .exit
+    cmp esi, 0x80000014 ; スレッド終了システムコールの番号
+    je  .exit
+
+    ; 終了を要求されていれば、アプリに戻らずに終了する
+    push rax
+    push rdx
+    cli
+    call LeaveSyscall
+    sti
+    test rax, rax
+    jnz .exit  ; RAX = OS用スタックポインタ, EDX = 終了コード
+    pop rdx
+    pop rax
+
+    mov rsp, rbp
+
+    pop rsi  ; システムコール番号を捨てる
 
     ; original RFLAGSを復帰
     pop r11
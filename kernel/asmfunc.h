@@ -30,11 +30,20 @@ void RestoreContext(void* ctx);
 int CallApp(int argc, char** argv, uint16_t ss, uint64_t rip, uint64_t rsp, uint64_t* os_stack_ptr);
 /// LAPICタイマ用割り込みハンドラ
 void IntHandlerLAPICTimer();
+/// デバイス使用不可例外（#NM）の割り込みハンドラ。FPUの状態を遅延して切り替える
+void IntHandlerNM();
 /// TRレジスタを設定
 void LoadTR(uint16_t sel);
 /// 指定のモデル固有レジスタに値を設定
 /// モデル固有レジスタ : MSR, Model Specific Register
 void WriteMSR(uint32_t msr, uint64_t value);
+/// 指定のモデル固有レジスタの値を取得
+uint64_t ReadMSR(uint32_t msr);
+/// タイムスタンプカウンタ（TSC）の値を取得
+/// TSC : CPUのクロックに同期して増加し続ける64bitカウンタ
+uint64_t ReadTSC();
+/// CPUID命令を実行し、結果を regs[0..3] = EAX, EBX, ECX, EDX に格納
+void CPUID(uint32_t leaf, uint32_t subleaf, uint32_t* regs);
 /// syscallでコールされるOS側の関数
 void SyscallEntry(void);
 /// アプリを強制終了させる
@@ -0,0 +1,245 @@
+#include "blit.hpp"
+
+#include <cpuid.h>
+#include <immintrin.h>
+
+#include <algorithm>
+
+namespace {
+    void FillScalar(uint32_t* dst, uint32_t value, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = value;
+        }
+    }
+
+    void CopyScalar(uint32_t* dst, const uint32_t* src, size_t n) {
+        for (size_t i = 0; i < n; i++) {
+            dst[i] = src[i];
+        }
+    }
+
+    void CopyKeyedScalar(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key) {
+        for (size_t i = 0; i < n; i++) {
+            if (src[i] != key) {
+                dst[i] = src[i];
+            }
+        }
+    }
+
+    /// x / 255 を丸めて求める（x <= 255 * 255）
+    inline uint32_t Div255(uint32_t x) {
+        x += 128;
+        return (x + (x >> 8)) >> 8;
+    }
+
+    // 重ね合わせの式（各チャネル8ビット、アルファ値を含めて4チャネルとも同じ式）
+    //   s' = s * opacity / 255
+    //   out = s' + d * (255 - s'のアルファ値) / 255
+    // SIMD 版も同じ式を同じ順で計算するので、結果はビット単位で一致する
+
+    void BlendScalar(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity, uint32_t alpha_or) {
+        for (size_t i = 0; i < n; i++) {
+            const uint32_t s = src[i] | alpha_or;
+            const uint32_t sa = Div255((s >> 24) * opacity);
+            uint32_t out = 0;
+            for (int shift = 0; shift < 32; shift += 8) {
+                const uint32_t sc = Div255(((s >> shift) & 0xff) * opacity);
+                const uint32_t dc = Div255(((dst[i] >> shift) & 0xff) * (255 - sa));
+                out |= std::min<uint32_t>(sc + dc, 255) << shift;
+            }
+            dst[i] = out;
+        }
+    }
+
+    // SSE2 版：4画素ずつ処理し、端数は1画素ずつ処理する
+    // 行の先頭が揃っているとは限らないので、読み書きはすべて非整列命令で行う
+
+    void FillSSE2(uint32_t* dst, uint32_t value, size_t n) {
+        const __m128i v = _mm_set1_epi32(value);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), v);
+        }
+        FillScalar(&dst[i], value, n - i);
+    }
+
+    void CopySSE2(uint32_t* dst, const uint32_t* src, size_t n) {
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+            const __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i + 4]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), a);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i + 4]), b);
+        }
+        CopyScalar(&dst[i], &src[i], n - i);
+    }
+
+    void CopyKeyedSSE2(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key) {
+        const __m128i k = _mm_set1_epi32(key);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128i s = _mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i]));
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i*>(&dst[i]));
+            // 透過色の画素は全ビット1、それ以外は0
+            const __m128i transparent = _mm_cmpeq_epi32(s, k);
+            const __m128i out = _mm_or_si128(_mm_and_si128(transparent, d), _mm_andnot_si128(transparent, s));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), out);
+        }
+        CopyKeyedScalar(&dst[i], &src[i], n - i, key);
+    }
+
+    inline __m128i Div255SSE2(__m128i x) {
+        x = _mm_add_epi16(x, _mm_set1_epi16(128));
+        return _mm_srli_epi16(_mm_add_epi16(x, _mm_srli_epi16(x, 8)), 8);
+    }
+
+    /// 16ビットに広げた2画素分を重ねる
+    inline __m128i Blend2SSE2(__m128i s, __m128i d, __m128i opacity) {
+        s = Div255SSE2(_mm_mullo_epi16(s, opacity));
+        // 各画素のアルファ値（4番目の要素）を4要素に広げる
+        const __m128i sa = _mm_shufflehi_epi16(_mm_shufflelo_epi16(s, 0xff), 0xff);
+        const __m128i inv = _mm_sub_epi16(_mm_set1_epi16(255), sa);
+        return _mm_add_epi16(s, Div255SSE2(_mm_mullo_epi16(d, inv)));
+    }
+
+    void BlendSSE2(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity, uint32_t alpha_or) {
+        const __m128i zero = _mm_setzero_si128();
+        const __m128i op = _mm_set1_epi16(opacity);
+        const __m128i aor = _mm_set1_epi32(alpha_or);
+        const __m128i alpha_mask = _mm_set1_epi32(0xff000000);
+        size_t i = 0;
+        for (; i + 4 <= n; i += 4) {
+            const __m128i s = _mm_or_si128(_mm_loadu_si128(reinterpret_cast<const __m128i*>(&src[i])), aor);
+            // 完全に透明な4画素は dst のまま、完全に不透明な4画素はそのまま写す
+            if (_mm_movemask_epi8(_mm_cmpeq_epi32(s, zero)) == 0xffff) {
+                continue;
+            }
+            if (opacity == 255 &&
+                _mm_movemask_epi8(_mm_cmpeq_epi32(_mm_and_si128(s, alpha_mask), alpha_mask)) == 0xffff) {
+                _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), s);
+                continue;
+            }
+            const __m128i d = _mm_loadu_si128(reinterpret_cast<__m128i*>(&dst[i]));
+            const __m128i lo = Blend2SSE2(_mm_unpacklo_epi8(s, zero), _mm_unpacklo_epi8(d, zero), op);
+            const __m128i hi = Blend2SSE2(_mm_unpackhi_epi8(s, zero), _mm_unpackhi_epi8(d, zero), op);
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(&dst[i]), _mm_packus_epi16(lo, hi));
+        }
+        BlendScalar(&dst[i], &src[i], n - i, opacity, alpha_or);
+    }
+
+    // AVX2 版：8画素ずつ処理する
+    // カーネル全体を AVX2 向けにはコンパイルせず、これらの関数だけ命令セットを広げる
+
+    __attribute__((target("avx2"))) void FillAVX2(uint32_t* dst, uint32_t value, size_t n) {
+        const __m256i v = _mm256_set1_epi32(value);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i]), v);
+        }
+        FillScalar(&dst[i], value, n - i);
+    }
+
+    __attribute__((target("avx2"))) void CopyAVX2(uint32_t* dst, const uint32_t* src, size_t n) {
+        size_t i = 0;
+        for (; i + 16 <= n; i += 16) {
+            const __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+            const __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i + 8]));
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i]), a);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i + 8]), b);
+        }
+        CopyScalar(&dst[i], &src[i], n - i);
+    }
+
+    __attribute__((target("avx2"))) void CopyKeyedAVX2(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key) {
+        const __m256i k = _mm256_set1_epi32(key);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256i s = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i]));
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i*>(&dst[i]));
+            const __m256i transparent = _mm256_cmpeq_epi32(s, k);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i]), _mm256_blendv_epi8(s, d, transparent));
+        }
+        CopyKeyedScalar(&dst[i], &src[i], n - i, key);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i Div255AVX2(__m256i x) {
+        x = _mm256_add_epi16(x, _mm256_set1_epi16(128));
+        return _mm256_srli_epi16(_mm256_add_epi16(x, _mm256_srli_epi16(x, 8)), 8);
+    }
+
+    __attribute__((target("avx2"))) inline __m256i Blend4AVX2(__m256i s, __m256i d, __m256i opacity) {
+        s = Div255AVX2(_mm256_mullo_epi16(s, opacity));
+        const __m256i sa = _mm256_shufflehi_epi16(_mm256_shufflelo_epi16(s, 0xff), 0xff);
+        const __m256i inv = _mm256_sub_epi16(_mm256_set1_epi16(255), sa);
+        return _mm256_add_epi16(s, Div255AVX2(_mm256_mullo_epi16(d, inv)));
+    }
+
+    __attribute__((target("avx2"))) void BlendAVX2(uint32_t* dst, const uint32_t* src, size_t n,
+                                                  uint32_t opacity, uint32_t alpha_or) {
+        const __m256i zero = _mm256_setzero_si256();
+        const __m256i op = _mm256_set1_epi16(opacity);
+        const __m256i aor = _mm256_set1_epi32(alpha_or);
+        const __m256i alpha_mask = _mm256_set1_epi32(0xff000000);
+        size_t i = 0;
+        for (; i + 8 <= n; i += 8) {
+            const __m256i s = _mm256_or_si256(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(&src[i])), aor);
+            if (_mm256_testz_si256(s, s)) {
+                continue;
+            }
+            if (opacity == 255 &&
+                static_cast<uint32_t>(_mm256_movemask_epi8(
+                    _mm256_cmpeq_epi32(_mm256_and_si256(s, alpha_mask), alpha_mask))) == 0xffffffff) {
+                _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i]), s);
+                continue;
+            }
+            const __m256i d = _mm256_loadu_si256(reinterpret_cast<__m256i*>(&dst[i]));
+            // unpack と pack はどちらも128ビットの単位ごとに働くので、画素の並びは元に戻る
+            const __m256i lo = Blend4AVX2(_mm256_unpacklo_epi8(s, zero), _mm256_unpacklo_epi8(d, zero), op);
+            const __m256i hi = Blend4AVX2(_mm256_unpackhi_epi8(s, zero), _mm256_unpackhi_epi8(d, zero), op);
+            _mm256_storeu_si256(reinterpret_cast<__m256i*>(&dst[i]), _mm256_packus_epi16(lo, hi));
+        }
+        BlendScalar(&dst[i], &src[i], n - i, opacity, alpha_or);
+    }
+
+    const BlitKernels* g_blit_kernels = nullptr;
+} // namespace
+
+const BlitKernels kScalarBlitKernels{"scalar", FillScalar, CopyScalar, CopyKeyedScalar, BlendScalar};
+const BlitKernels kSSE2BlitKernels{"sse2", FillSSE2, CopySSE2, CopyKeyedSSE2, BlendSSE2};
+const BlitKernels kAVX2BlitKernels{"avx2", FillAVX2, CopyAVX2, CopyKeyedAVX2, BlendAVX2};
+
+bool CPUSupportsAVX2() {
+    unsigned int eax, ebx, ecx, edx;
+    if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    // OS が XSAVE を有効にしていなければ、YMM レジスタはタスク切り替えで保存されない
+    if ((ecx & bit_OSXSAVE) == 0 || (ecx & bit_AVX) == 0) {
+        return false;
+    }
+    uint32_t xcr0_lo, xcr0_hi;
+    __asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+    if ((xcr0_lo & 0x6) != 0x6) { // XMM と YMM の状態が有効か
+        return false;
+    }
+
+    if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) {
+        return false;
+    }
+    return (ebx & bit_AVX2) != 0;
+}
+
+const BlitKernels& GetBlitKernels() {
+    // 複数のタスクが同時に選んでも結果は同じなので、排他制御は不要
+    // カーネルは XSAVE を有効にせず、タスク切り替えでは fxsave で XMM までしか保存しないので、
+    // YMM レジスタを使う AVX2 の実装は選ばない（ホストでのテスト用に残してある）
+    if (g_blit_kernels == nullptr) {
+        unsigned int eax, ebx, ecx, edx;
+        if (__get_cpuid(1, &eax, &ebx, &ecx, &edx) && (edx & bit_SSE2)) {
+            g_blit_kernels = &kSSE2BlitKernels;
+        } else {
+            g_blit_kernels = &kScalarBlitKernels;
+        }
+    }
+    return *g_blit_kernels;
+}
@@ -0,0 +1,50 @@
+/// 32ビット画素の行を塗る・写す基本処理
+/// SSE2, AVX2 の実装を用意し、カーネルで使える最も速いものを選ぶ
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+/// 1行分（n 画素）を処理する関数の組
+struct BlitKernels {
+    const char* name;
+    /// dst に value を n 個並べる
+    void (*fill)(uint32_t* dst, uint32_t value, size_t n);
+    /// src から dst へ n 画素写す（領域は重ならないこと）
+    void (*copy)(uint32_t* dst, const uint32_t* src, size_t n);
+    /// key と等しくない画素だけを src から dst へ写す（透過色つきの転送）
+    void (*copy_keyed)(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key);
+    /// 乗算済みアルファの src を不透明度 opacity (0-255) で dst に重ねる
+    /// src の各画素には alpha_or を OR してから使う（0xff000000 なら src を不透明として扱う）
+    void (*blend)(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity, uint32_t alpha_or);
+};
+
+/// どの CPU でも動く実装（他の実装の検証にも使う）
+extern const BlitKernels kScalarBlitKernels;
+/// x86-64 では常に使える
+extern const BlitKernels kSSE2BlitKernels;
+/// CPUSupportsAVX2() が true のときだけ使える
+/// カーネルは YMM レジスタをタスクごとに保存しないので GetBlitKernels() は選ばない（ホストでのテスト用）
+extern const BlitKernels kAVX2BlitKernels;
+
+/// CPU が AVX2 に対応し、かつ YMM レジスタの保存が OS により有効になっている -> true
+bool CPUSupportsAVX2();
+/// カーネルで使える最も速い実装（初回の呼び出しで決める）
+const BlitKernels& GetBlitKernels();
+
+inline void FillRow32(uint32_t* dst, uint32_t value, size_t n) {
+    GetBlitKernels().fill(dst, value, n);
+}
+
+inline void CopyRow32(uint32_t* dst, const uint32_t* src, size_t n) {
+    GetBlitKernels().copy(dst, src, n);
+}
+
+inline void BlendRow32(uint32_t* dst, const uint32_t* src, size_t n, uint32_t opacity, uint32_t alpha_or) {
+    GetBlitKernels().blend(dst, src, n, opacity, alpha_or);
+}
+
+inline void CopyRowKeyed32(uint32_t* dst, const uint32_t* src, size_t n, uint32_t key) {
+    GetBlitKernels().copy_keyed(dst, src, n, key);
+}
@@ -0,0 +1,188 @@
+#include "compositor.hpp"
+
+#include <algorithm>
+#include <vector>
+
+#include "layer.hpp"
+#include "logger.hpp"
+#include "task.hpp"
+#include "timer.hpp"
+
+namespace {
+    /// 次のフレームの時刻に合成タスクを起こすタイマの値
+    const int kFrameTimer = 1;
+    /// 合成タスクが動作するタスクのレベル（メインタスクより下、アプリより上）
+    const int kCompositorLevel = 2;
+
+    /// フレームの通知を待っているタスクとレイヤー
+    struct FrameRequest {
+        uint64_t task_id;
+        unsigned int layer_id;
+    };
+    /// 同時に受け付けるフレーム要求の数の上限
+    const size_t kMaxFrameRequests = 64;
+
+    Task* g_compositor_task = nullptr;
+    std::vector<FrameRequest>* g_frame_requests;
+    int g_refresh_rate = kDefaultRefreshRate;
+    CompositorStats g_stats{};
+
+    uint64_t FramePeriodNanoseconds() {
+        return 1000000000ul / g_refresh_rate;
+    }
+
+    /// period 単位の時刻の区切りのうち、t より後の最初のもの
+    uint64_t NextBoundary(uint64_t t, uint64_t period) {
+        return (t / period + 1) * period;
+    }
+
+    void TaskCompositor(uint64_t task_id, int64_t data) {
+        Task& task = *g_compositor_task;
+        // 次にフレームを反映してよい時刻。これより前のダメージはこの時刻まで待たせる
+        uint64_t next_frame_ns = 0;
+        // フレームの時刻を待っている間は、タイマを重ねて登録しない
+        bool frame_timer_armed = false;
+        // ダメージを抱えたまま next_frame_ns を待った -> true
+        bool waited = false;
+
+        while (true) {
+            __asm__("cli");
+            auto msg = task.ReceiveMessage();
+            __asm__("sti");
+
+            if (msg) {
+                switch (msg->type) {
+                case Message::kLayer:
+                    // 描画する領域を記録するだけなので、届いた要求はまとめて処理してから合成する
+                    // 送信元は描画の終了を待たないので、完了の通知は送らない
+                    // （送ると、イベントを読まないアプリのタスクのメッセージキューがあふれる）
+                    ProcessLayerMessage(*msg);
+                    break;
+                case Message::kTimerTimeout:
+                    if (msg->arg.timer.value == kFrameTimer) {
+                        frame_timer_armed = false;
+                    }
+                    break;
+                default:
+                    Log(kError, "compositor: unknown message type: %d\n", msg->type);
+                }
+                continue;
+            }
+
+            __asm__("cli");
+            // フレームの要求があれば、ダメージがなくてもフレームの時刻を刻む
+            const bool has_work = g_layer_manager->HasDamage() || !g_frame_requests->empty();
+            __asm__("sti");
+            if (has_work && !frame_timer_armed) {
+                const uint64_t now = NowNanoseconds();
+                const uint64_t period = FramePeriodNanoseconds();
+                if (now >= next_frame_ns) {
+                    // 直前のフレームから1周期以上たっていれば、待たずに反映する
+                    // 合成している間に届いた要求は、次のフレームで通知する
+                    __asm__("cli");
+                    const std::vector<FrameRequest> requests = *g_frame_requests;
+                    g_frame_requests->clear();
+                    __asm__("sti");
+
+                    g_layer_manager->Flush();
+                    const uint64_t end = NowNanoseconds();
+
+                    // 反映すべき時刻から周期をまたいで遅れた分と、合成が周期より長引いた分は見送ったフレームとなる
+                    uint64_t dropped = (end - now) / period;
+                    if (waited) {
+                        dropped += (now - next_frame_ns) / period;
+                        waited = false;
+                    }
+                    next_frame_ns = NextBoundary(end, period);
+
+                    __asm__("cli");
+                    g_stats.frames++;
+                    g_stats.dropped_frames += dropped;
+                    g_stats.frame_time.Record((end - now) / 1000);
+                    Message msg{Message::kFrame, task_id};
+                    msg.arg.frame.time_ns = end;
+                    msg.arg.frame.sequence = g_stats.frames;
+                    for (const auto& req : requests) {
+                        msg.arg.frame.layer_id = req.layer_id;
+                        g_task_manager->SendMessage(req.task_id, msg);
+                    }
+                    __asm__("sti");
+                    continue;
+                }
+
+                // 次のフレームの時刻（ティックに切り上げる）まで眠る
+                const unsigned long timeout =
+                    (next_frame_ns * kTimerFreq + 999999999) / 1000000000;
+                __asm__("cli");
+                if (!g_timer_manager->AddTimer(Timer{timeout, kFrameTimer, task_id}).error) {
+                    frame_timer_armed = true;
+                    waited = true;
+                }
+                __asm__("sti");
+                if (!frame_timer_armed) {
+                    // タイマを登録できなければ待たずに反映する
+                    next_frame_ns = 0;
+                    continue;
+                }
+            }
+
+            __asm__("cli");
+            // 確認している間に届いたメッセージやダメージがあれば、眠らずに処理する
+            if (!task.PeekMessage() &&
+                (frame_timer_armed || (!g_layer_manager->HasDamage() && g_frame_requests->empty()))) {
+                task.Sleep();
+            }
+            __asm__("sti");
+        }
+    }
+} // namespace
+
+void InitializeCompositor() {
+    g_frame_requests = new std::vector<FrameRequest>;
+    g_frame_requests->reserve(kMaxFrameRequests);
+
+    __asm__("cli");
+    Task& task = g_task_manager->NewTask()
+                     .InitContext(TaskCompositor, 0)
+                     .SetName("compositor");
+    g_compositor_task = &task;
+    g_task_manager->Wakeup(&task, kCompositorLevel);
+    __asm__("sti");
+}
+
+uint64_t CompositorTaskID() {
+    return g_compositor_task ? g_compositor_task->ID() : 0;
+}
+
+void SetRefreshRate(int hz) {
+    g_refresh_rate = std::clamp(hz, 1, kTimerFreq);
+}
+
+int RefreshRate() {
+    return g_refresh_rate;
+}
+
+Error RequestFrame(uint64_t task_id, unsigned int layer_id) {
+    // 同じ要求が重なっても、通知は1回にまとめる
+    for (const auto& req : *g_frame_requests) {
+        if (req.task_id == task_id && req.layer_id == layer_id) {
+            return MAKE_ERROR(Error::kSuccess);
+        }
+    }
+    if (g_frame_requests->size() >= kMaxFrameRequests) {
+        return MAKE_ERROR(Error::kFull);
+    }
+    g_frame_requests->push_back({task_id, layer_id});
+    if (g_task_manager->CurrentTask().ID() != g_compositor_task->ID()) {
+        g_task_manager->Wakeup(g_compositor_task);
+    }
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+CompositorStats GetCompositorStats() {
+    return g_stats;
+}
+
+void ResetCompositorStats() {
+    g_stats = CompositorStats{};
+}
@@ -0,0 +1,37 @@
+/// 画面の合成を専用のタスクで一定の間隔ごとに行う仕組み
+
+#pragma once
+
+#include <cstdint>
+
+#include "error.hpp"
+#include "latency_histogram.hpp"
+
+/// 合成の既定の頻度（1秒あたりのフレーム数）
+const int kDefaultRefreshRate = 60;
+
+struct CompositorStats {
+    /// 画面に反映したフレームの数
+    uint64_t frames;
+    /// 描画要求があったのに反映が間に合わず、飛ばしたフレームの数
+    uint64_t dropped_frames;
+    /// 1フレームの合成にかかった時間の分布（µs）
+    LatencyHistogram frame_time;
+};
+
+/// 合成タスクを起動する
+/// 以後、レイヤ操作要求（Message::kLayer）はこのタスクに送り、ダメージの反映もこのタスクが行う
+void InitializeCompositor();
+/// 合成タスクのID。起動前は0
+uint64_t CompositorTaskID();
+/// 合成の頻度を設定する（1以上 kTimerFreq 以下に丸める）
+void SetRefreshRate(int hz);
+int RefreshRate();
+/// 次に画面へ反映したフレームの時刻を Message::kFrame でタスクに通知するよう要求する
+/// ダメージがなくても、要求があれば次のフレームの時刻に通知する。1回通知したら要求は消える
+/// 割り込み禁止状態で呼び出すこと
+Error RequestFrame(uint64_t task_id, unsigned int layer_id);
+/// 統計情報の写しを返す。割り込み禁止状態で呼び出すこと
+CompositorStats GetCompositorStats();
+/// 統計情報を消去する。割り込み禁止状態で呼び出すこと
+void ResetCompositorStats();
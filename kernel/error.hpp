@@ -35,6 +35,11 @@ public:
         kIsDirectory,
         kNoSuchEntry,
         kFreeTypeError,
+        kInvalidTask,
+        kTimeout,
+        kValueChanged,
+        kBusy,
+        kInterrupted,
         kLastOfCode, // この列挙子は常に最後に配置する
     };
 
@@ -69,6 +74,11 @@ private:
         "kIsDirectory",
         "kNoSuchEntry",
         "kFreeTypeError",
+        "kInvalidTask",
+        "kTimeout",
+        "kValueChanged",
+        "kBusy",
+        "kInterrupted",
     };
     static_assert(Error::Code::kLastOfCode == code_names_.size());
 
@@ -327,7 +327,7 @@ namespace fat {
             }
 
             uint8_t* sec = GetSectorByCluster<uint8_t>(wr_cluster_);
-            size_t n = std::min(len, g_bytes_per_cluster - wr_cluster_off_);
+            size_t n = std::min(len - total, g_bytes_per_cluster - wr_cluster_off_);
             memcpy(&sec[wr_cluster_off_], &buf8[total], n);
             total += n;
 
@@ -339,6 +339,41 @@ namespace fat {
         return total;
     }
 
+    std::pair<const void*, size_t> FileDescriptor::ReadableSpan() {
+        if (rd_cluster_ == 0) {
+            rd_cluster_ = fat_entry_.FirstCluster();
+        }
+        const size_t remain = fat_entry_.file_size - rd_off_;
+        if (remain == 0 || rd_cluster_ == 0 || rd_cluster_ == kEndOfClusterchain) {
+            return {nullptr, 0};
+        }
+
+        // クラスタ番号が連続していれば、ボリュームイメージ上でも隣り合っているのでまとめて返す
+        size_t n = g_bytes_per_cluster - rd_cluster_off_;
+        unsigned long cluster = rd_cluster_;
+        while (n < remain) {
+            const auto next_cluster = NextCluster(cluster);
+            if (next_cluster != cluster + 1) {
+                break;
+            }
+            cluster = next_cluster;
+            n += g_bytes_per_cluster;
+        }
+
+        uint8_t* sec = GetSectorByCluster<uint8_t>(rd_cluster_);
+        return {&sec[rd_cluster_off_], std::min(n, remain)};
+    }
+
+    void FileDescriptor::Consume(size_t len) {
+        len = std::min(len, fat_entry_.file_size - rd_off_);
+        rd_off_ += len;
+        rd_cluster_off_ += len;
+        while (rd_cluster_off_ >= g_bytes_per_cluster) {
+            rd_cluster_ = NextCluster(rd_cluster_);
+            rd_cluster_off_ -= g_bytes_per_cluster;
+        }
+    }
+
     size_t FileDescriptor::Load(void* buf, size_t len, size_t offset) {
         FileDescriptor fd{fat_entry_};
         fd.rd_off_ = offset;
@@ -171,6 +171,9 @@ namespace fat {
         size_t Size() const override { return fat_entry_.file_size; }
         /// 指定位置からファイルを読む
         size_t Load(void* buf, size_t len, size_t offset) override;
+        /// 読み込み位置から、ボリュームイメージ上で連続して並ぶクラスタの範囲
+        std::pair<const void*, size_t> ReadableSpan() override;
+        void Consume(size_t len) override;
 
     private:
         /// ファイルへの参照
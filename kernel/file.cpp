@@ -1,6 +1,8 @@
 #include "file.hpp"
 
+#include <algorithm>
 #include <cstdio>
+#include <memory>
 
 size_t PrintToFD(IFileDescriptor& fd, const char* format, ...) {
     va_list ap;
@@ -15,6 +17,41 @@ size_t PrintToFD(IFileDescriptor& fd, const char* format, ...) {
     return result;
 }
 
+size_t Splice(IFileDescriptor& out, IFileDescriptor& in, size_t len) {
+    // ReadableSpan() に対応していないときだけ使う中継バッファ
+    const size_t kBounceBytes = 4096;
+    std::unique_ptr<uint8_t[]> bounce;
+
+    size_t total = 0;
+    while (total < len) {
+        auto [span, span_len] = in.ReadableSpan();
+        if (span_len > 0) {
+            const size_t n = std::min(span_len, len - total);
+            const size_t written = out.Write(span, n);
+            in.Consume(written);
+            total += written;
+            if (written < n) { // 書き込み先が閉じられた
+                break;
+            }
+            continue;
+        }
+
+        if (!bounce) {
+            bounce = std::make_unique<uint8_t[]>(kBounceBytes);
+        }
+        const size_t n = in.Read(bounce.get(), std::min(kBounceBytes, len - total));
+        if (n == 0) { // 終端
+            break;
+        }
+        const size_t written = out.Write(bounce.get(), n);
+        total += written;
+        if (written < n) {
+            break;
+        }
+    }
+    return total;
+}
+
 size_t ReadDelim(IFileDescriptor& fd, char delim, char* buf, size_t len) {
     size_t i = 0;
     for (; i < len - 1; i++) {
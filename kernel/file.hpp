@@ -1,8 +1,12 @@
 #pragma once
 
 #include <cstddef>
+#include <utility>
 
 #include "error.hpp"
+#include "poll.hpp"
+
+class WaitQueue;
 
 /// 文字列（orバイト列）を扱える何か
 class IFileDescriptor {
@@ -14,9 +18,25 @@ public:
 
     /// Load() reads file content without changing internal offset
     virtual size_t Load(void* buf, size_t len, size_t offset) = 0;
+
+    /// ブロックせずに読み書きできるか（POLL_READABLE, POLL_WRITABLE の組み合わせ）
+    /// 割り込みを禁止して呼び出す
+    virtual int Poll() { return POLL_READABLE | POLL_WRITABLE; }
+    /// Poll() の結果が変わったときに起こしてもらう待機キュー
+    /// nullptr なら結果は変わらない（普通のファイルは常に読み書きできる）
+    virtual WaitQueue* PollWaitQueue() { return nullptr; }
+
+    /// 次に Read() で読まれるデータのうち、カーネル内で連続して置かれている領域
+    /// コピーせずに読むために使う。対応していないか、今すぐ読めるデータがなければ大きさ0
+    virtual std::pair<const void*, size_t> ReadableSpan() { return {nullptr, 0}; }
+    /// ReadableSpan() の先頭 len バイトを読んだことにする
+    virtual void Consume(size_t len) {}
 };
 
 /// 指定ファイルディスクリプタに文字列を書き込む
 size_t PrintToFD(IFileDescriptor& fd, const char* format, ...);
+/// in から out へ最大 len バイト（in が終端に達するまで）転送し、転送したバイト数を返す
+/// in が ReadableSpan() に対応していれば、その領域から直接 out に書き込む
+size_t Splice(IFileDescriptor& out, IFileDescriptor& in, size_t len);
 /// 指定文字に出会うまで1byteずつ読み取る
 size_t ReadDelim(IFileDescriptor& fd, char delim, char* buf, size_t len);
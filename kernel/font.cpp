@@ -50,11 +50,7 @@ void WriteAscii(PixelWriter& writer, Vector2D<int> pos, char c, const PixelColor
     }
 
     for (int dy = 0; dy < 16; dy++) {
-        for (int dx = 0; dx < 8; dx++) {
-            if ((font[dy] << dx) & 0x80u) {
-                writer.Write(pos + Vector2D<int>{dx, dy}, color);
-            }
-        }
+        writer.WriteMaskedRow(pos + Vector2D<int>{0, dy}, &font[dy], 8, color);
     }
 }
 
@@ -155,12 +151,7 @@ Error WriteUnicode(PixelWriter& writer, Vector2D<int> pos, char32_t c, const Pix
             q -= bitmap.pitch * bitmap.rows;
         }
 
-        for (int dx = 0; dx < bitmap.width; dx++) {
-            const bool b = q[dx >> 3] & (0x80 >> (dx & 0x7));
-            if (b) {
-                writer.Write(glyph_topleft + Vector2D<int>{dx, dy}, color);
-            }
-        }
+        writer.WriteMaskedRow(glyph_topleft + Vector2D<int>{0, dy}, q, bitmap.width, color);
     }
 
     // フェースオブジェクト破棄
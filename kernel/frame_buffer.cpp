@@ -1,6 +1,13 @@
 #include "frame_buffer.hpp"
 
+#include "blit.hpp"
+
 namespace {
+    /// バッファを確保するとき、1行の画素数をこの倍数（32バイト）に揃える
+    const uint32_t kScanLineAlignPixels = 8;
+    /// 自前のバッファの先頭と大きさを揃える単位（ページの大きさ）
+    const size_t kPageBytes = 4096;
+
     int BytesPerPixel(const PixelFormat& format) {
         switch (format) {
         case kPixelRGBResv8BitPerColor:
@@ -24,6 +31,15 @@ namespace {
         return {static_cast<int>(config.horizontal_resolution),
                 static_cast<int>(config.vertical_resolution)};
     }
+
+    /// dst_pos に src_area を写すとき、両方のフレームバッファに収まる範囲（dst 側の座標）
+    Rectangle<int> CopyArea(const FrameBufferConfig& dst, Vector2D<int> dst_pos,
+                            const FrameBufferConfig& src, const Rectangle<int>& src_area) {
+        const Rectangle<int> src_area_shifted{dst_pos, src_area.size};
+        const Rectangle<int> src_outline{dst_pos - src_area.pos, FrameBufferSize(src)};
+        const Rectangle<int> dst_outline{{0, 0}, FrameBufferSize(dst)};
+        return dst_outline & src_outline & src_area_shifted;
+    }
 } // namespace
 
 Error FrameBuffer::Initailize(const FrameBufferConfig& config) {
@@ -36,11 +52,17 @@ Error FrameBuffer::Initailize(const FrameBufferConfig& config) {
 
     if (config_.frame_buffer) {
         buffer_.resize(0);
+        buffer_bytes_ = 0;
     } else {
-        buffer_.resize(
-            bytes_per_pixel * config_.horizontal_resolution * config_.vertical_resolution);
-        config_.frame_buffer = buffer_.data();
-        config_.pixels_per_scan_line = config_.horizontal_resolution;
+        // 各行の先頭を揃えておき、行単位のコピーを速くする
+        config_.pixels_per_scan_line =
+            (config_.horizontal_resolution + kScanLineAlignPixels - 1) / kScanLineAlignPixels * kScanLineAlignPixels;
+        // アプリのアドレス空間にもそのままマップできるよう、4KiB境界から4KiB単位で使う
+        const size_t bytes = bytes_per_pixel * config_.pixels_per_scan_line * config_.vertical_resolution;
+        buffer_bytes_ = (bytes + kPageBytes - 1) / kPageBytes * kPageBytes;
+        buffer_.resize(buffer_bytes_ + kPageBytes - 1);
+        const auto addr = reinterpret_cast<uintptr_t>(buffer_.data());
+        config_.frame_buffer = reinterpret_cast<uint8_t*>((addr + kPageBytes - 1) & ~(kPageBytes - 1));
     }
 
     switch (config_.pixel_format) {
@@ -67,10 +89,7 @@ Error FrameBuffer::Copy(Vector2D<int> dst_pos, const FrameBuffer& src, const Rec
         return MAKE_ERROR(Error::kUnknownPixelFormat);
     }
 
-    const Rectangle<int> src_area_shifted{dst_pos, src_area.size};
-    const Rectangle<int> src_outline{dst_pos - src_area.pos, FrameBufferSize(src.config_)};
-    const Rectangle<int> dst_outline{{0, 0}, FrameBufferSize(config_)};
-    const auto copy_area = dst_outline & src_outline & src_area_shifted;
+    const auto copy_area = CopyArea(config_, dst_pos, src.config_, src_area);
     const auto src_start_pos = copy_area.pos - (dst_pos - src_area.pos);
 
     uint8_t* dst_buf = FrameAddrAt(copy_area.pos, config_);
@@ -78,7 +97,7 @@ Error FrameBuffer::Copy(Vector2D<int> dst_pos, const FrameBuffer& src, const Rec
 
     // ピクセル毎ではなく1行毎にコピーしていく
     for (int y = 0; y < copy_area.size.y; y++) {
-        memcpy(dst_buf, src_buf, bytes_per_pixel * copy_area.size.x);
+        CopyRow32(reinterpret_cast<uint32_t*>(dst_buf), reinterpret_cast<const uint32_t*>(src_buf), copy_area.size.x);
         dst_buf += BytesPerScanLine(config_);
         src_buf += BytesPerScanLine(src.config_);
     }
@@ -86,15 +105,73 @@ Error FrameBuffer::Copy(Vector2D<int> dst_pos, const FrameBuffer& src, const Rec
     return MAKE_ERROR(Error::kSuccess);
 }
 
+Error FrameBuffer::CopyTransparent(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area,
+                                   const PixelColor& transparent) {
+    if (config_.pixel_format != src.config_.pixel_format) {
+        return MAKE_ERROR(Error::kUnknownPixelFormat);
+    }
+
+    const auto copy_area = CopyArea(config_, dst_pos, src.config_, src_area);
+    const auto src_start_pos = copy_area.pos - (dst_pos - src_area.pos);
+    // 色を1度だけ画素形式に変換し、画素のまま比べる
+    const uint32_t tc = src.Encode(transparent);
+
+    for (int y = 0; y < copy_area.size.y; y++) {
+        uint32_t* dst_buf = PixelAt(copy_area.pos + Vector2D<int>{0, y});
+        const uint32_t* src_buf = src.PixelAt(src_start_pos + Vector2D<int>{0, y});
+        CopyRowKeyed32(dst_buf, src_buf, copy_area.size.x, tc);
+    }
+
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+Error FrameBuffer::Blend(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area,
+                         uint8_t opacity, bool src_alpha) {
+    if (config_.pixel_format != src.config_.pixel_format) {
+        return MAKE_ERROR(Error::kUnknownPixelFormat);
+    }
+
+    const auto copy_area = CopyArea(config_, dst_pos, src.config_, src_area);
+    const auto src_start_pos = copy_area.pos - (dst_pos - src_area.pos);
+    // アルファ値を使わないなら、src の4バイト目に何が入っていても不透明として扱う
+    const uint32_t alpha_or = src_alpha ? 0 : 0xff000000;
+
+    for (int y = 0; y < copy_area.size.y; y++) {
+        BlendRow32(PixelAt(copy_area.pos + Vector2D<int>{0, y}), src.PixelAt(src_start_pos + Vector2D<int>{0, y}),
+                   copy_area.size.x, opacity, alpha_or);
+    }
+
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+uint32_t FrameBuffer::Encode(const PixelColor& color) const {
+    if (config_.pixel_format == kPixelRGBResv8BitPerColor) {
+        return EncodePixel<kPixelRGBResv8BitPerColor>(color);
+    }
+    return EncodePixel<kPixelBGRResv8BitPerColor>(color);
+}
+
+PixelColor FrameBuffer::Decode(uint32_t pixel) const {
+    if (config_.pixel_format == kPixelRGBResv8BitPerColor) {
+        return DecodePixel<kPixelRGBResv8BitPerColor>(pixel);
+    }
+    return DecodePixel<kPixelBGRResv8BitPerColor>(pixel);
+}
+
 void FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
     const auto bytes_per_pixel = BytesPerPixel(config_.pixel_format);
     const auto bytes_per_scan_line = BytesPerScanLine(config_);
 
-    if (dst_pos.y < src.pos.y) { // 上に移動
+    if (dst_pos.y == src.pos.y) { // 横に移動。行内で領域が重なりうる
+        for (int y = 0; y < src.size.y; y++) {
+            memmove(FrameAddrAt(dst_pos + Vector2D<int>{0, y}, config_),
+                    FrameAddrAt(src.pos + Vector2D<int>{0, y}, config_), bytes_per_pixel * src.size.x);
+        }
+    } else if (dst_pos.y < src.pos.y) { // 上に移動
         uint8_t* dst_buf = FrameAddrAt(dst_pos, config_);
         const uint8_t* src_buf = FrameAddrAt(src.pos, config_);
         for (int y = 0; y < src.size.y; y++) {
-            memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
+            CopyRow32(reinterpret_cast<uint32_t*>(dst_buf), reinterpret_cast<const uint32_t*>(src_buf), src.size.x);
             dst_buf += bytes_per_scan_line;
             src_buf += bytes_per_scan_line;
         }
@@ -102,7 +179,7 @@ void FrameBuffer::Move(Vector2D<int> dst_pos, const Rectangle<int>& src) {
         uint8_t* dst_buf = FrameAddrAt(dst_pos + Vector2D<int>{0, src.size.y - 1}, config_);
         const uint8_t* src_buf = FrameAddrAt(src.pos + Vector2D<int>{0, src.size.y - 1}, config_);
         for (int y = 0; y < src.size.y; y++) {
-            memcpy(dst_buf, src_buf, bytes_per_pixel * src.size.x);
+            CopyRow32(reinterpret_cast<uint32_t*>(dst_buf), reinterpret_cast<const uint32_t*>(src_buf), src.size.x);
             dst_buf -= bytes_per_scan_line;
             src_buf -= bytes_per_scan_line;
         }
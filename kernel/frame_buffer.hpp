@@ -13,14 +13,36 @@ class FrameBuffer {
 public:
     Error Initailize(const FrameBufferConfig& config);
     Error Copy(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area);
+    /// Copy() と同じだが、src の transparent 色の画素はコピーしない
+    Error CopyTransparent(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area,
+                          const PixelColor& transparent);
+    /// Copy() と同じだが、src を不透明度 opacity で dst に重ねる
+    /// src_alpha : true なら src の画素ごとのアルファ値（乗算済み）も使う
+    Error Blend(Vector2D<int> dst_pos, const FrameBuffer& src, const Rectangle<int>& src_area,
+                uint8_t opacity, bool src_alpha);
     /// このウィンドウの平面領域内で、矩形領域を移動する
     void Move(Vector2D<int> dst_pos, const Rectangle<int>& src);
     FrameBufferWriter& Writer() { return *writer_; };
     const FrameBufferConfig& Config() const { return config_; }
+    /// 自前で確保したバッファの大きさ（4KiBの倍数）。外部のバッファを使っているなら0
+    size_t BufferBytes() const { return buffer_bytes_; }
+
+    /// 色をこのフレームバッファの画素形式（1画素4バイト）に変換する
+    uint32_t Encode(const PixelColor& color) const;
+    /// このフレームバッファの画素形式から色に戻す
+    PixelColor Decode(uint32_t pixel) const;
+    /// 指定位置の画素
+    uint32_t* PixelAt(Vector2D<int> pos) {
+        return reinterpret_cast<uint32_t*>(config_.frame_buffer) + config_.pixels_per_scan_line * pos.y + pos.x;
+    }
+    const uint32_t* PixelAt(Vector2D<int> pos) const {
+        return reinterpret_cast<const uint32_t*>(config_.frame_buffer) + config_.pixels_per_scan_line * pos.y + pos.x;
+    }
 
 private:
     FrameBufferConfig config_{};
     /// フレームバッファ本体
     std::vector<uint8_t> buffer_{};
+    size_t buffer_bytes_{0};
     std::unique_ptr<FrameBufferWriter> writer_{};
 };
@@ -0,0 +1,149 @@
+#include "futex.hpp"
+
+#include <array>
+
+#include "paging.hpp"
+#include "task.hpp"
+#include "timer.hpp"
+
+namespace {
+    /// 待機中のタスク。待機しているタスクのスタック上に置く
+    struct FutexWaiter {
+        /// 待機しているアドレスの物理アドレス
+        uint64_t key;
+        Task* task;
+        bool woken;
+        FutexWaiter* next;
+    };
+
+    /// 待機キューのハッシュ表の大きさ（2の累乗）
+    const size_t kNumFutexBuckets = 64;
+    /// 物理アドレスのハッシュ値ごとの待機キュー（単方向リスト）
+    std::array<FutexWaiter*, kNumFutexBuckets> g_futex_buckets{};
+
+    FutexWaiter*& Bucket(uint64_t key) {
+        return g_futex_buckets[(key >> 2) & (kNumFutexBuckets - 1)];
+    }
+
+    /// アプリに割り当て得るアドレスか
+    /// ELF・デマンドページング範囲と、メモリマップドファイル以降（スレッドのスタック、時刻情報ページ、スタック）の範囲
+    /// GetPhysicalAddress() がOS側のメモリや範囲外のアドレスにフレームを割り当てないよう、先に確かめる
+    bool IsAppAddress(const Task& task, uint64_t addr) {
+        if (addr < 0xffff800000000000) {
+            return false;
+        }
+        return addr < task.DPagingEnd() || task.FileMapEnd() <= addr;
+    }
+
+    void Unlink(FutexWaiter* waiter) {
+        for (FutexWaiter** p = &Bucket(waiter->key); *p; p = &(*p)->next) {
+            if (*p == waiter) {
+                *p = waiter->next;
+                return;
+            }
+        }
+    }
+} // namespace
+
+Error FutexWait(uint64_t addr, uint32_t expected, unsigned long timeout) {
+    if (addr % sizeof(uint32_t) != 0) {
+        return MAKE_ERROR(Error::kInvalidFormat);
+    }
+    __asm__("cli");
+    const bool valid_addr = IsAppAddress(g_task_manager->CurrentTask(), addr);
+    __asm__("sti");
+    if (!valid_addr) {
+        return MAKE_ERROR(Error::kIndexOutOfRange);
+    }
+    auto [key, err] = GetPhysicalAddress(addr);
+    if (err) {
+        return err;
+    }
+
+    __asm__("cli");
+    // 割り込みを禁止してから値を確かめるので、確かめてから眠るまでの間の起床を取りこぼさない
+    if (*reinterpret_cast<volatile uint32_t*>(addr) != expected) {
+        __asm__("sti");
+        return MAKE_ERROR(Error::kValueChanged);
+    }
+
+    Task& task = g_task_manager->CurrentTask();
+    FutexWaiter waiter{key, &task, false, Bucket(key)};
+    Bucket(key) = &waiter;
+
+    TimerHandle timer = 0;
+    unsigned long deadline = kNoTimeout;
+    if (timeout != kNoTimeout) {
+        deadline = g_timer_manager->CurrentTick() + timeout;
+        auto [handle, err_timer] = g_timer_manager->AddTimer(Timer{deadline, kTimerWakeup, task.ID()});
+        if (err_timer) {
+            Unlink(&waiter);
+            __asm__("sti");
+            return err_timer;
+        }
+        timer = handle;
+    }
+
+    // メッセージの受信などでも起こされるので、起床したかタイムアウトするまで眠り直す
+    // 終了を要求されたときも待つのをやめる
+    while (!waiter.woken && g_timer_manager->CurrentTick() < deadline && !task.ExitRequested()) {
+        task.Sleep();
+    }
+    if (!waiter.woken) {
+        Unlink(&waiter);
+    }
+    if (timer) {
+        g_timer_manager->CancelTimer(timer);
+    }
+    __asm__("sti");
+
+    if (waiter.woken) {
+        return MAKE_ERROR(Error::kSuccess);
+    }
+    return MAKE_ERROR(task.ExitRequested() ? Error::kInterrupted : Error::kTimeout);
+}
+
+WithError<int> FutexWake(uint64_t addr, int n) {
+    if (addr % sizeof(uint32_t) != 0) {
+        return {0, MAKE_ERROR(Error::kInvalidFormat)};
+    }
+    __asm__("cli");
+    const bool valid_addr = IsAppAddress(g_task_manager->CurrentTask(), addr);
+    __asm__("sti");
+    if (!valid_addr) {
+        return {0, MAKE_ERROR(Error::kIndexOutOfRange)};
+    }
+    auto [key, err] = GetPhysicalAddress(addr);
+    if (err) {
+        return {0, err};
+    }
+
+    int num_woken = 0;
+    __asm__("cli");
+    for (FutexWaiter** p = &Bucket(key); *p && num_woken < n;) {
+        FutexWaiter* waiter = *p;
+        if (waiter->key != key) {
+            p = &waiter->next;
+            continue;
+        }
+        // 先に待ち始めたタスクほどリストの後ろにいるが、起こす順序は保証しない
+        *p = waiter->next;
+        waiter->woken = true;
+        waiter->task->Wakeup();
+        num_woken++;
+    }
+    __asm__("sti");
+    return {num_woken, MAKE_ERROR(Error::kSuccess)};
+}
+
+void CancelFutexWait(Task* task) {
+    for (FutexWaiter*& head : g_futex_buckets) {
+        for (FutexWaiter** p = &head; *p;) {
+            if ((*p)->task == task) {
+                *p = (*p)->next;
+            } else {
+                p = &(*p)->next;
+            }
+        }
+    }
+}
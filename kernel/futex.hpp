@@ -0,0 +1,22 @@
+/// フューテックス : アプリのメモリ上の32bit値を使った待機と起床
+/// 競合のないロック操作はアプリ内で完結させ、競合したときだけカーネルで眠る
+
+#pragma once
+
+#include <cstdint>
+
+#include "error.hpp"
+
+class Task;
+
+/// *addr が expected と等しい間、FutexWake() で起こされるまで眠る
+/// 待機キューはアドレスに対応する物理アドレスで区別するので、スレッド間で共有するメモリならどこでも使える
+/// timeout : タイムアウトまでのティック数（kNoTimeout なら無期限）
+/// return : 起こされた : kSuccess、値が異なった : kValueChanged、タイムアウト : kTimeout、
+///          終了を要求された : kInterrupted、アプリのアドレス空間の外 : kIndexOutOfRange
+Error FutexWait(uint64_t addr, uint32_t expected, unsigned long timeout);
+/// addr で待機しているタスクを最大 n 個起こす
+/// return : 起こしたタスクの数。アプリのアドレス空間の外なら kIndexOutOfRange
+WithError<int> FutexWake(uint64_t addr, int n);
+/// 指定のタスクを待機キューから外す（タスクを強制的に終了させる前に呼び出す）
+void CancelFutexWait(Task* task);
@@ -1,39 +1,45 @@
 #include "graphics.hpp"
 
-void RGBResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor& color) {
-    auto p = PixelAt(pos);
-    p[0] = color.r;
-    p[1] = color.g;
-    p[2] = color.b;
+void PixelWriter::FillSpan(Vector2D<int> pos, int len, const PixelColor& color) {
+    for (int dx = 0; dx < len; dx++) {
+        Write(pos + Vector2D<int>{dx, 0}, color);
+    }
+}
+
+void PixelWriter::FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& color) {
+    for (int dy = 0; dy < size.y; dy++) {
+        FillSpan(pos + Vector2D<int>{0, dy}, size.x, color);
+    }
 }
 
-void BGRResv8BitPerColorPixelWriter::Write(Vector2D<int> pos, const PixelColor& color) {
-    auto p = PixelAt(pos);
-    p[0] = color.b;
-    p[1] = color.g;
-    p[2] = color.r;
+void PixelWriter::BlitRect(Vector2D<int> pos, Vector2D<int> size, const uint32_t* pixels, int stride) {
+    for (int dy = 0; dy < size.y; dy++) {
+        for (int dx = 0; dx < size.x; dx++) {
+            // 既定の実装はアルファ値を無視する
+            Write(pos + Vector2D<int>{dx, dy}, ToColor(pixels[dy * stride + dx]));
+        }
+    }
+}
+
+void PixelWriter::WriteMaskedRow(Vector2D<int> pos, const uint8_t* mask, int width, const PixelColor& color) {
+    for (int dx = 0; dx < width; dx++) {
+        if (mask[dx >> 3] & (0x80u >> (dx & 7))) {
+            Write(pos + Vector2D<int>{dx, 0}, color);
+        }
+    }
 }
 
 void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos, const Vector2D<int>& size, const PixelColor& color) {
     // 上辺と下辺
-    for (int dx = 0; dx < size.x; dx++) {
-        writer.Write(pos + Vector2D<int>{dx, 0}, color);
-        writer.Write(pos + Vector2D<int>{dx, size.y - 1}, color);
-    }
+    writer.FillSpan(pos, size.x, color);
+    writer.FillSpan(pos + Vector2D<int>{0, size.y - 1}, size.x, color);
     // 左辺と右辺
-    for (int dy = 1; dy < size.y; dy++) {
-        writer.Write(pos + Vector2D<int>{0, dy}, color);
-        writer.Write(pos + Vector2D<int>{size.x - 1, dy}, color);
-    }
+    writer.FillRect(pos + Vector2D<int>{0, 1}, {1, size.y - 1}, color);
+    writer.FillRect(pos + Vector2D<int>{size.x - 1, 1}, {1, size.y - 1}, color);
 }
 
-/// 描画領域塗りつぶし
 void FillRectangle(PixelWriter& writer, const Vector2D<int>& pos, const Vector2D<int>& size, const PixelColor& color) {
-    for (int dy = 0; dy < size.y; dy++) {
-        for (int dx = 0; dx < size.x; dx++) {
-            writer.Write(pos + Vector2D<int>{dx, dy}, color);
-        }
-    }
+    writer.FillRect(pos, size, color);
 }
 
 void DrawDesktop(PixelWriter& writer) {
@@ -3,10 +3,13 @@
 #include <algorithm>
 #include <cstdint>
 
+#include "blit.hpp"
 #include "frame_buffer_config.hpp"
 
 struct PixelColor {
     uint8_t r, g, b;
+    /// 不透明度。アルファ値を使うウィンドウ（Window::SetAlpha）でだけ意味を持つ
+    uint8_t a = 255;
 };
 
 constexpr PixelColor ToColor(uint32_t c) {
@@ -18,13 +21,60 @@ constexpr PixelColor ToColor(uint32_t c) {
 }
 
 inline bool operator==(const PixelColor& lhs, const PixelColor& rhs) {
-    return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b;
+    return lhs.r == rhs.r && lhs.g == rhs.g && lhs.b == rhs.b && lhs.a == rhs.a;
 }
 
 inline bool operator!=(const PixelColor& lhs, const PixelColor& rhs) {
     return !(lhs == rhs);
 }
 
+/// 色を1画素4バイトの画素形式に変換する
+/// 4バイト目にアルファ値を置き、各色はアルファ値を乗じた値（乗算済みアルファ）にする
+template <PixelFormat F>
+constexpr uint32_t EncodePixel(const PixelColor& c);
+
+/// c * a / 255 を丸めて求める
+constexpr uint32_t Premultiply(uint8_t c, uint8_t a) {
+    const uint32_t x = c * a + 128;
+    return (x + (x >> 8)) >> 8;
+}
+
+template <>
+constexpr uint32_t EncodePixel<kPixelRGBResv8BitPerColor>(const PixelColor& c) {
+    return Premultiply(c.r, c.a) | (Premultiply(c.g, c.a) << 8) | (Premultiply(c.b, c.a) << 16) |
+           (static_cast<uint32_t>(c.a) << 24);
+}
+
+template <>
+constexpr uint32_t EncodePixel<kPixelBGRResv8BitPerColor>(const PixelColor& c) {
+    return Premultiply(c.b, c.a) | (Premultiply(c.g, c.a) << 8) | (Premultiply(c.r, c.a) << 16) |
+           (static_cast<uint32_t>(c.a) << 24);
+}
+
+/// 0xAARRGGBB 形式（乗算済みアルファ）の画素を1画素4バイトの画素形式に変換する
+template <PixelFormat F>
+constexpr uint32_t EncodeRGB(uint32_t argb);
+
+template <>
+constexpr uint32_t EncodeRGB<kPixelRGBResv8BitPerColor>(uint32_t argb) {
+    return (argb & 0xff00ff00) | ((argb >> 16) & 0xff) | ((argb & 0xff) << 16);
+}
+
+template <>
+constexpr uint32_t EncodeRGB<kPixelBGRResv8BitPerColor>(uint32_t argb) {
+    // メモリ上の並びが B, G, R, A なので、そのまま使える
+    return argb;
+}
+
+/// 1画素4バイトの画素形式から色に戻す（各色は乗算済みのまま）
+template <PixelFormat F>
+constexpr PixelColor DecodePixel(uint32_t pixel) {
+    const uint32_t argb = EncodeRGB<F>(pixel); // 赤と青を入れ替える変換は、逆変換と同じ
+    PixelColor c = ToColor(argb);
+    c.a = argb >> 24;
+    return c;
+}
+
 template <typename T>
 struct Vector2D {
     T x, y;
@@ -94,6 +144,21 @@ public:
     virtual void Write(Vector2D<int> pos, const PixelColor& color) = 0;
     virtual int Width() const = 0;
     virtual int Height() const = 0;
+
+    // 以下は複数の画素をまとめて描く
+    // 既定の実装は Write() を1画素ずつ呼ぶので、まとめて速く描ける派生クラスは上書きする
+
+    /// pos から右へ len 画素を塗る
+    virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& color);
+    /// 矩形を塗る
+    virtual void FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& color);
+    /// 0xAARRGGBB 形式の画素を並べた配列を矩形に描く
+    /// AA はアルファ値を使うウィンドウでだけ意味を持ち、RRGGBB はアルファ値を乗じた値とする
+    /// stride : 配列の1行あたりの要素数
+    virtual void BlitRect(Vector2D<int> pos, Vector2D<int> size, const uint32_t* pixels, int stride);
+    /// mask の各バイトを上位ビットから順に見て、1のビットに対応する画素だけを塗る
+    /// width : 1行の画素数（mask のビット数）
+    virtual void WriteMaskedRow(Vector2D<int> pos, const uint8_t* mask, int width, const PixelColor& color);
 };
 
 class FrameBufferWriter : public PixelWriter {
@@ -112,16 +177,84 @@ private:
     const FrameBufferConfig& config_;
 };
 
-class RGBResv8BitPerColorPixelWriter : public FrameBufferWriter {
+/// 画素形式ごとに特殊化した書き込み
+/// 色の変換は呼び出しごとに1回だけ行い、各行へは32ビット単位で書き込む
+/// まとめて描く処理は、描画範囲を Width() x Height() に切り詰める
+template <PixelFormat F>
+class PixelFormatWriter : public FrameBufferWriter {
 public:
     using FrameBufferWriter::FrameBufferWriter;
-    virtual void Write(Vector2D<int> pos, const PixelColor& color) override;
+
+    virtual void Write(Vector2D<int> pos, const PixelColor& color) override {
+        *Pixel(pos) = EncodePixel<F>(color);
+    }
+
+    virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& color) override {
+        FillRect(pos, {len, 1}, color);
+    }
+
+    virtual void FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& color) override {
+        const auto area = Clip(pos, size);
+        const uint32_t c = EncodePixel<F>(color);
+        for (int y = 0; y < area.size.y; y++) {
+            FillRow32(Pixel(area.pos + Vector2D<int>{0, y}), c, area.size.x);
+        }
+    }
+
+    virtual void BlitRect(Vector2D<int> pos, Vector2D<int> size, const uint32_t* pixels, int stride) override {
+        const auto area = Clip(pos, size);
+        const auto src_pos = area.pos - pos;
+        for (int y = 0; y < area.size.y; y++) {
+            uint32_t* p = Pixel(area.pos + Vector2D<int>{0, y});
+            const uint32_t* src = &pixels[(src_pos.y + y) * stride + src_pos.x];
+            if constexpr (F == kPixelBGRResv8BitPerColor) {
+                CopyRow32(p, src, area.size.x);
+            } else {
+                for (int x = 0; x < area.size.x; x++) {
+                    p[x] = EncodeRGB<F>(src[x]);
+                }
+            }
+        }
+    }
+
+    virtual void WriteMaskedRow(Vector2D<int> pos, const uint8_t* mask, int width, const PixelColor& color) override {
+        if (pos.y < 0 || Height() <= pos.y) {
+            return;
+        }
+        const uint32_t c = EncodePixel<F>(color);
+        uint32_t* p = Pixel({0, pos.y});
+        const int x_end = std::min(width, Width() - pos.x);
+        for (int dx = std::max(0, -pos.x); dx < x_end; dx++) {
+            if (mask[dx >> 3] & (0x80u >> (dx & 7))) {
+                p[pos.x + dx] = c;
+            }
+        }
+    }
+
+private:
+    uint32_t* Pixel(Vector2D<int> pos) {
+        return reinterpret_cast<uint32_t*>(PixelAt(pos));
+    }
+
+    /// 描画範囲に収まる部分。収まらなければ大きさ0
+    Rectangle<int> Clip(Vector2D<int> pos, Vector2D<int> size) const {
+        const auto begin = ElementMax(pos, Vector2D<int>{0, 0});
+        const auto end = ElementMin(pos + size, Vector2D<int>{Width(), Height()});
+        if (end.x <= begin.x || end.y <= begin.y) {
+            return {begin, {0, 0}};
+        }
+        return {begin, end - begin};
+    }
 };
 
-class BGRResv8BitPerColorPixelWriter : public FrameBufferWriter {
+class RGBResv8BitPerColorPixelWriter : public PixelFormatWriter<kPixelRGBResv8BitPerColor> {
 public:
-    using FrameBufferWriter::FrameBufferWriter;
-    virtual void Write(Vector2D<int> pos, const PixelColor& color) override;
+    using PixelFormatWriter::PixelFormatWriter;
+};
+
+class BGRResv8BitPerColorPixelWriter : public PixelFormatWriter<kPixelBGRResv8BitPerColor> {
+public:
+    using PixelFormatWriter::PixelFormatWriter;
 };
 
 void DrawRectangle(PixelWriter& writer, const Vector2D<int>& pos, const Vector2D<int>& size, const PixelColor& color);
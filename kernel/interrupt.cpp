@@ -9,6 +9,8 @@
 #include "segment.hpp"
 #include "task.hpp"
 #include "timer.hpp"
+#include "usb/xhci/xhci.hpp"
+#include "workqueue.hpp"
 
 #include "logger.hpp"
 
@@ -32,10 +34,25 @@ void NotifyEndOfInterrupt() {
 }
 
 namespace {
+    /// xHCIのイベント処理をワーカタスクに依頼済みなら true
+    volatile bool g_xhci_work_pending = false;
+
+    /// ワーカタスクでxHCIのイベントリングを処理する
+    void ProcessXHCIEvents(uint64_t arg) {
+        // 処理中に届いたイベントのために、処理を始める前に再依頼を許可する
+        g_xhci_work_pending = false;
+        usb::xhci::ProcessEvents();
+    }
+
     /// xHCI用割り込みハンドラ
     __attribute__((interrupt)) void IntHandlerXHCI(InterruptFrame* frame) {
-        // メインタスクに通知
-        g_task_manager->SendMessage(kMainTaskID, Message{Message::kInterruptXHCI});
+        // イベント処理は優先度の高いワーカタスクに任せる
+        if (!g_xhci_work_pending) {
+            g_xhci_work_pending = true;
+            if (QueueWork(ProcessXHCIEvents, 0, WorkPriority::kHigh)) {
+                g_xhci_work_pending = false;
+            }
+        }
         NotifyEndOfInterrupt();
     }
 
@@ -122,7 +139,6 @@ namespace {
     FaultHandlerNoError(OF);
     FaultHandlerNoError(BR);
     FaultHandlerNoError(UD);
-    FaultHandlerNoError(NM);
     FaultHandlerWithError(DF);
     FaultHandlerWithError(TS);
     FaultHandlerWithError(NP);
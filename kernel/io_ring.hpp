@@ -0,0 +1,66 @@
+/// 非同期の要求・完了リング
+/// アプリとカーネルが共有するページ上に、要求（SQE）のリングと完了通知（CQE）のリングを置く
+/// アプリは要求をまとめて書き込み、1回のシステムコールでカーネルに処理させる
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 要求リングと完了リングの要素数（2の累乗）
+#define IO_RING_SQ_ENTRIES 256
+#define IO_RING_CQ_ENTRIES 512
+
+/// 要求の種類。値はそれぞれのシステムコールの番号（下位ビット）と同じで、引数の意味も同じ
+#define IO_OP_PUT_STRING 0x01
+#define IO_OP_WIN_WRITE_STRING 0x04
+#define IO_OP_WIN_FILL_RECTANGLE 0x05
+#define IO_OP_WIN_REDRAW 0x07
+#define IO_OP_WIN_DRAW_LINE 0x08
+#define IO_OP_CREATE_TIMER 0x0b
+#define IO_OP_READ_FILE 0x0d
+#define IO_OP_CANCEL_TIMER 0x10
+#define IO_OP_WIN_BLIT 0x1a
+
+/// 成功したときは完了通知を書き込まない
+#define IO_SQE_SKIP_SUCCESS 0x01
+
+/// 要求
+struct IoRingSqe {
+    uint32_t opcode;
+    uint32_t flags;
+    /// 完了通知にそのまま書き戻される値
+    uint64_t user_data;
+    /// システムコールの引数
+    uint64_t args[6];
+};
+
+/// 完了通知
+struct IoRingCqe {
+    uint64_t user_data;
+    /// システムコールの戻り値
+    uint64_t value;
+    int32_t error;
+    uint32_t reserved;
+};
+
+/// 共有ページの先頭に置くリングの管理情報
+/// 添字は増え続ける値で、要素数で割った余りの位置を使う
+/// 要求リング : アプリが sq_tail を、カーネルが sq_head を進める
+/// 完了リング : カーネルが cq_tail を、アプリが cq_head を進める
+struct IoRing {
+    volatile uint32_t sq_head, sq_tail;
+    volatile uint32_t cq_head, cq_tail;
+    /// 完了リングに空きがなく、処理を打ち切った回数
+    volatile uint32_t cq_overflow;
+    uint32_t reserved[11];
+    struct IoRingSqe sqes[IO_RING_SQ_ENTRIES];
+    struct IoRingCqe cqes[IO_RING_CQ_ENTRIES];
+};
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
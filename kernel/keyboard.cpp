@@ -65,6 +65,8 @@ void InitializeKeyboard() {
         msg.arg.keyboard.ascii = ascii;
         msg.arg.keyboard.press = press;
         // メインタスクに割り込みを通知
+        __asm__("cli");
         g_task_manager->SendMessage(kMainTaskID, msg);
+        __asm__("sti");
     };
 }
\ No newline at end of file
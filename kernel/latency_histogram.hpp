@@ -0,0 +1,61 @@
+/// 待ち時間の分布を対数目盛りで数えるヒストグラム
+
+#pragma once
+
+#include <array>
+#include <cstdint>
+
+class LatencyHistogram {
+public:
+    static const int kNumBuckets = 24;
+
+    /// 待ち時間（マイクロ秒）を1つ記録する
+    /// バケット0は1µs未満、バケットi（i >= 1）は [2^(i-1), 2^i) µs。上限を超えたものは最後のバケットに入れる
+    void Record(uint64_t us) {
+        int i = us == 0 ? 0 : 64 - __builtin_clzll(us);
+        if (i >= kNumBuckets) {
+            i = kNumBuckets - 1;
+        }
+        buckets_[i]++;
+        count_++;
+        if (us > max_) {
+            max_ = us;
+        }
+    }
+
+    /// 記録された待ち時間のうち、小さい方から percent % の位置にある値を含むバケットの上限（µs）
+    /// 記録がなければ0
+    uint64_t Percentile(int percent) const {
+        if (count_ == 0) {
+            return 0;
+        }
+        // 切り上げで順位を求める
+        const uint64_t rank = (count_ * percent + 99) / 100;
+        uint64_t sum = 0;
+        for (int i = 0; i < kNumBuckets; i++) {
+            sum += buckets_[i];
+            if (sum >= rank && sum > 0) {
+                return BucketUpperBound(i);
+            }
+        }
+        return BucketUpperBound(kNumBuckets - 1);
+    }
+
+    void Reset() {
+        buckets_ = {};
+        count_ = 0;
+        max_ = 0;
+    }
+
+    uint64_t Count() const { return count_; }
+    uint64_t Max() const { return max_; }
+    const std::array<uint64_t, kNumBuckets>& Buckets() const { return buckets_; }
+
+    /// バケットiに入る待ち時間の上限（この値は含まない）
+    static uint64_t BucketUpperBound(int i) { return uint64_t{1} << i; }
+
+private:
+    std::array<uint64_t, kNumBuckets> buckets_{};
+    uint64_t count_{0};
+    uint64_t max_{0};
+};
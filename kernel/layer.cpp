@@ -2,6 +2,7 @@
 
 #include <algorithm>
 
+#include "compositor.hpp"
 #include "console.hpp"
 #include "logger.hpp"
 #include "task.hpp"
@@ -12,6 +13,31 @@ namespace {
         auto it = std::remove_if(c.begin(), c.end(), pred);
         c.erase(it, c.end());
     }
+
+    /// 割り込みを禁止し、直前に許可されていた -> true
+    /// 割り込み禁止状態のまま呼び出されることがある処理で使う
+    bool SaveAndDisableInterrupt() {
+        uint64_t rflags;
+        __asm__ volatile("pushfq\n\tpopq %0\n\tcli" : "=r"(rflags) : : "memory");
+        return rflags & 0x200;
+    }
+
+    void RestoreInterrupt(bool enabled) {
+        if (enabled) {
+            __asm__("sti");
+        }
+    }
+
+    /// 合成を始めた時点のレイヤーの状態
+    /// 合成中にレイヤーが動かされたり削除されたりしても影響を受けないよう、ウィンドウの所有権ももつ
+    struct LayerSnapshot {
+        std::shared_ptr<Window> window;
+        Vector2D<int> pos;
+        uint8_t opacity;
+        bool opaque;
+        /// 上のレイヤーに隠されていない部分
+        Region visible;
+    };
 } // namespace
 
 Layer::Layer(unsigned int id) : id_{id} {}
@@ -42,6 +68,19 @@ bool Layer::IsDraggable() const {
     return draggable_;
 }
 
+Layer& Layer::SetOpacity(uint8_t opacity) {
+    opacity_ = opacity;
+    return *this;
+}
+
+uint8_t Layer::Opacity() const {
+    return opacity_;
+}
+
+bool Layer::IsOpaque() const {
+    return window_ && window_->IsOpaque() && opacity_ == 255;
+}
+
 Layer& Layer::Move(Vector2D<int> pos) {
     pos_ = pos;
     return *this;
@@ -54,7 +93,7 @@ Layer& Layer::MoveRelative(Vector2D<int> pos_diff) {
 
 void Layer::DrawTo(FrameBuffer& screen, const Rectangle<int>& area) const {
     if (window_) {
-        window_->DrawTo(screen, pos_, area);
+        window_->DrawTo(screen, pos_, area, opacity_);
     }
 }
 
@@ -82,10 +121,24 @@ void LayerManager::RemoveLayer(unsigned int id) {
 }
 
 void LayerManager::Draw(const Rectangle<int>& area) const {
-    for (auto layer : layer_stack_) {
-        layer->DrawTo(back_buffer_, area);
+    const auto clipped = area & Rectangle<int>{{0, 0}, ScreenSize()};
+    if (IsEmpty(clipped)) {
+        return;
     }
-    screen_->Copy(area.pos, back_buffer_, area);
+
+    const bool intr = SaveAndDisableInterrupt();
+    damage_.Add(clipped);
+    const auto compositor_id = CompositorTaskID();
+    if (compositor_id == 0) {
+        // 合成タスクの起動前は、その場で描画する
+        RestoreInterrupt(intr);
+        Flush();
+        return;
+    }
+    if (g_task_manager->CurrentTask().ID() != compositor_id) {
+        g_task_manager->Wakeup(compositor_id);
+    }
+    RestoreInterrupt(intr);
 }
 
 void LayerManager::Draw(unsigned int id) const {
@@ -94,25 +147,61 @@ void LayerManager::Draw(unsigned int id) const {
 }
 
 void LayerManager::Draw(unsigned int id, Rectangle<int> area) const {
-    bool draw = false;
-    Rectangle<int> window_area;
+    // 他のタスクがレイヤーを操作している途中の状態を見ないようにする
+    const bool intr = SaveAndDisableInterrupt();
+    for (auto layer : layer_stack_) {
+        if (layer->ID() != id) {
+            continue;
+        }
+        Rectangle<int> window_area;
+        window_area.size = layer->GetWindow()->Size();
+        window_area.pos = layer->GetPosition();
+        if (area.size.x >= 0 || area.size.y >= 0) {
+            // areaはウィンドウの左上を基準とした座標、window_areaはフレームバッファの左上を基準とした座標なので座標系を合わせる
+            area.pos = area.pos + window_area.pos;
+            window_area = window_area & area;
+        }
+        // 上のレイヤーも下のレイヤーも Flush() で合成し直すので、領域だけ記録すればよい
+        Draw(window_area);
+        break;
+    }
+    RestoreInterrupt(intr);
+}
+
+void LayerManager::Flush() const {
+    // 描画中に追加されたダメージは次回にまわす
+    // 合成は割り込みを許可したまま行うので、レイヤーの状態は写しをとっておく
+    const bool intr = SaveAndDisableInterrupt();
+    Region damage;
+    std::swap(damage, damage_);
+    std::vector<LayerSnapshot> layers;
+    layers.reserve(layer_stack_.size());
     for (auto layer : layer_stack_) {
-        // 再描画されたレイヤーより前面のレイヤーはすべて再描画
-        if (layer->ID() == id) {
-            window_area.size = layer->GetWindow()->Size();
-            window_area.pos = layer->GetPosition();
-            if (area.size.x >= 0 || area.size.y >= 0) {
-                // areaはウィンドウの左上を基準とした座標、window_areaはフレームバッファの左上を基準とした座標なので座標系を合わせる
-                area.pos = area.pos + window_area.pos;
-                window_area = window_area & area;
-            }
-            draw = true;
+        if (layer->GetWindow()) {
+            layers.push_back({layer->GetWindow(), layer->GetPosition(), layer->Opacity(), layer->IsOpaque(), {}});
+        }
+    }
+    RestoreInterrupt(intr);
+
+    // 最前面から順に、上にある不透明なレイヤーに隠されていない部分を求める
+    Region uncovered = damage;
+    for (auto it = layers.rbegin(); it != layers.rend() && !uncovered.Empty(); ++it) {
+        const Rectangle<int> window_area{it->pos, it->window->Size()};
+        it->visible = uncovered.Intersection(window_area);
+        if (it->opaque) {
+            uncovered.Subtract(window_area);
         }
-        if (draw) {
-            layer->DrawTo(back_buffer_, window_area);
+    }
+
+    // 半透明のレイヤーは下のレイヤーと混ぜるので、描画は最背面から行う
+    for (const auto& layer : layers) {
+        for (const auto& rect : layer.visible.Rects()) {
+            layer.window->DrawTo(back_buffer_, layer.pos, rect, layer.opacity);
         }
     }
-    screen_->Copy(window_area.pos, back_buffer_, window_area);
+    for (const auto& rect : damage.Rects()) {
+        screen_->Copy(rect.pos, back_buffer_, rect);
+    }
 }
 
 void LayerManager::Move(unsigned int id, Vector2D<int> new_position) {
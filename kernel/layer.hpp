@@ -8,6 +8,7 @@
 
 #include "graphics.hpp"
 #include "message.hpp"
+#include "region.hpp"
 #include "window.hpp"
 
 /// 1つの描画層
@@ -27,6 +28,11 @@ public:
     Vector2D<int> GetPosition() const;
     Layer& SetDraggable(bool draggable);
     bool IsDraggable() const;
+    /// レイヤー全体の不透明度（255 なら不透明）。再描画はしない
+    Layer& SetOpacity(uint8_t opacity);
+    uint8_t Opacity() const;
+    /// 下のレイヤーを完全に覆い隠す -> true
+    bool IsOpaque() const;
 
     /// レイヤーの位置情報を指定の絶対座標へと更新。再描画はしない
     Layer& Move(Vector2D<int> pos);
@@ -43,6 +49,7 @@ private:
     std::shared_ptr<Window> window_{};
     // true : マウスドラッグ可能
     bool draggable_{false};
+    uint8_t opacity_{255};
 };
 
 /// 複数のレイヤーを管理する
@@ -56,13 +63,19 @@ public:
     /// 指定レイヤーを削除
     void RemoveLayer(unsigned int id);
 
-    /// 現在表示状態にあるレイヤーを描画
+    /// 指定領域を再描画が必要な領域（ダメージ）に加える
+    /// 実際の描画は Flush() でまとめて行う
     void Draw(const Rectangle<int>& area) const;
-    /// 指定レイヤーに設定されているウィンドウの描画領域内を描画
+    /// 指定レイヤーに設定されているウィンドウの描画領域をダメージに加える
     void Draw(unsigned int id) const;
-    /// 指定レイヤーに設定されているウィンドウの指定描画領域内を描画
+    /// 指定レイヤーに設定されているウィンドウの指定描画領域をダメージに加える
     /// area : ウィンドウの左上の基準とした座標
     void Draw(unsigned int id, Rectangle<int> area) const;
+    /// たまったダメージについて、表示中のレイヤーの隠されていない部分だけを最背面から合成して画面へ転送する
+    /// 合成タスクから呼び出す（合成タスクの起動前は Draw() が呼び出す）
+    void Flush() const;
+    /// 描画されていないダメージがある -> true（割り込み禁止状態で呼び出す）
+    bool HasDamage() const { return !damage_.Empty(); }
 
     /// 例親ーの位置情報を指定の絶対座標へと更新。再描画。
     void Move(unsigned int id, Vector2D<int> new_position);
@@ -88,6 +101,8 @@ private:
     /// ダブルバッファリング用
     /// mutable修飾子はconstメソッド内からでも変更可能
     mutable FrameBuffer back_buffer_{};
+    /// まだ画面に反映していない領域（画面の座標系）
+    mutable Region damage_{};
     /// レイヤ一覧
     std::vector<std::unique_ptr<Layer>> layers_{};
     /// 配列の先頭を再背面、末尾を最前面とする。非表示レイヤは含まない
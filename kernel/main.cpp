@@ -9,6 +9,7 @@
 
 #include "acpi.hpp"
 #include "asmfunc.h"
+#include "compositor.hpp"
 #include "console.hpp"
 #include "fat.hpp"
 #include "font.hpp"
@@ -31,6 +32,7 @@
 #include "timer.hpp"
 #include "usb/xhci/xhci.hpp"
 #include "window.hpp"
+#include "workqueue.hpp"
 
 int printk(const char* format, ...) {
     va_list ap;
@@ -153,8 +155,10 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig& frame_buffer_config,
     // テキストボックスのカーソル点滅
     const int kTextboxCursorTimer = 1;
     const int kTimer05sec = static_cast<int>(kTimerFreq * 0.5);
-    // 0,5secでタイムアウトするタイマ
-    g_timer_manager->AddTimer(Timer{kTimer05sec, kTextboxCursorTimer, kMainTaskID});
+    // 0,5secごとにタイムアウトする周期タイマ
+    __asm__("cli");
+    g_timer_manager->AddTimer(Timer{kTimer05sec, kTextboxCursorTimer, kMainTaskID, kTimer05sec});
+    __asm__("sti");
     bool textbox_cursor_visible = false;
 
     // システムコール
@@ -164,6 +168,10 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig& frame_buffer_config,
     InitializeTask();
     // このタスク（KernelMainStack()）
     Task& main_task = g_task_manager->CurrentTask();
+    // 割り込みの後半処理を行うワーカタスク
+    InitializeWorkQueue();
+    // 画面の合成を行うタスク
+    InitializeCompositor();
 
     // USBデバイス
     // xHCIは初期化するとすぐに割り込みが発生するので、タスク機能を初期化してからにする
@@ -179,6 +187,8 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig& frame_buffer_config,
         .Wakeup();
 
     char str[128];
+    // 最後にカウンタを表示したときのティック
+    unsigned long shown_tick = kNoTimeout;
     // 割り込みイベントループ
     while (true) {
         // clear interrupt : 割り込みを無効化
@@ -189,11 +199,14 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig& frame_buffer_config,
         __asm__("sti");
         // 割り込みが発生すると、この次の行から処理を再開
 
-        sprintf(str, "%010lu", tick);
-        FillRectangle(*g_main_window->InnerWriter(), {20, 4}, {8 * 10, 16}, {0xc6, 0xc6, 0xc6});
-        WriteString(*g_main_window->InnerWriter(), {20, 4}, str, {0, 0, 0});
-        // カウンタの表示はメインウィンドウだけを再描画
-        g_layer_manager->Draw(g_main_window_layer_id);
+        if (tick != shown_tick) {
+            sprintf(str, "%010lu", tick);
+            FillRectangle(*g_main_window->InnerWriter(), {20, 4}, {8 * 10, 16}, {0xc6, 0xc6, 0xc6});
+            WriteString(*g_main_window->InnerWriter(), {20, 4}, str, {0, 0, 0});
+            // カウンタの表示はメインウィンドウだけを再描画
+            g_layer_manager->Draw(g_main_window_layer_id);
+            shown_tick = tick;
+        }
 
         __asm__("cli");
         auto msg = main_task.ReceiveMessage();
@@ -206,15 +219,12 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig& frame_buffer_config,
         __asm__("sti");
 
         switch (msg->type) {
-        case Message::kInterruptXHCI:
-            usb::xhci::ProcessEvents();
+        case Message::kMouseInput:
+            ProcessMouseMessage(*msg);
             break;
         case Message::kTimerTimeout:
             // カーソル点滅タイマがタイムアウトした場合
             if (msg->arg.timer.value == kTextboxCursorTimer) {
-                __asm__("cli");
-                g_timer_manager->AddTimer(Timer{msg->arg.timer.timeout + kTimer05sec, kTextboxCursorTimer, kMainTaskID});
-                __asm__("sti");
                 textbox_cursor_visible = !textbox_cursor_visible;
                 DrawTextCursor(textbox_cursor_visible);
                 g_layer_manager->Draw(g_text_window_layer_id);
@@ -247,15 +257,6 @@ extern "C" void KernelMainNewStack(const FrameBufferConfig& frame_buffer_config,
                 }
             }
             break;
-        case Message::kLayer:
-            // 描画中の割り込みは許可しておく
-            // 描画処理は低優先度な割にリソースを食うため、割り込みを禁止すると取りこぼしてしまうから
-            ProcessLayerMessage(*msg);
-            __asm__("cli");
-            // 送信元タスクに描画終了を通知
-            g_task_manager->SendMessage(msg->src_task, Message{Message::kLayerFinish});
-            __asm__("sti");
-            break;
         default:
             Log(kError, "Unknown message type: %d\n", msg->type);
         }
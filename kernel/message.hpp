@@ -16,16 +16,15 @@ enum class LayerOperation {
 /// 割り込みメッセージ
 struct Message {
     enum Type {
-        kInterruptXHCI,
         kTimerTimeout,
         kKeyPush,
         kLayer,
-        kLayerFinish,
         kMouseMove,
         kMouseButton,
         kWindowActive,
-        kPipe,
         kWindowClose,
+        kMouseInput,
+        kFrame,
     } type;
 
     /// メッセージ送信元のタスクID
@@ -82,15 +81,24 @@ struct Message {
             int activate;
         } window_active;
 
-        /// パイプによる送信データ
-        struct {
-            char data[16];
-            uint8_t len;
-        } pipe;
-
         /// ウィンドウを閉じる
         struct {
             unsigned int layer_id;
         } window_close;
+
+        /// マウスからの入力（USBドライバからメインタスクへ）
+        struct {
+            uint8_t buttons;
+            int8_t displacement_x, displacement_y;
+        } mouse_input;
+
+        /// フレームを画面に反映した（合成タスクからフレームを要求したタスクへ）
+        struct {
+            unsigned int layer_id;
+            /// 反映した時刻（起動からのナノ秒）
+            uint64_t time_ns;
+            /// 反映したフレームの通し番号
+            uint64_t sequence;
+        } frame;
     } arg;
 };
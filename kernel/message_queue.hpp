@@ -0,0 +1,103 @@
+/// 複数の送信者と1つの受信者の間で使う固定長のメッセージキュー
+
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+
+/// 複数送信者・単一受信者（MPSC）のロックフリーなリングバッファ
+/// 要素の領域はあらかじめ確保しておくので、割り込みハンドラからもヒープを使わずに送信できる
+/// 各セルのシーケンス番号で書き込み完了を判定する（Dmitry Vyukov の bounded queue）
+template <class T, size_t N>
+class MPSCQueue {
+public:
+    static_assert(N >= 2 && (N & (N - 1)) == 0, "N must be a power of 2");
+
+    MPSCQueue() {
+        for (size_t i = 0; i < N; i++) {
+            cells_[i].seq.store(i, std::memory_order_relaxed);
+        }
+    }
+
+    MPSCQueue(const MPSCQueue&) = delete;
+    MPSCQueue& operator=(const MPSCQueue&) = delete;
+
+    /// 末尾に要素を追加する。どのコンテキストからでも呼び出せる
+    /// 満杯のときは追加せずにあふれ回数を数え、false を返す
+    bool Push(const T& value) {
+        size_t pos = tail_.load(std::memory_order_relaxed);
+        Cell* cell;
+        while (true) {
+            cell = &cells_[pos & (N - 1)];
+            const size_t seq = cell->seq.load(std::memory_order_acquire);
+            const auto diff = static_cast<intptr_t>(seq) - static_cast<intptr_t>(pos);
+            if (diff == 0) {
+                // このセルが空いているので、書き込み位置の確保を試みる
+                if (tail_.compare_exchange_weak(pos, pos + 1, std::memory_order_relaxed)) {
+                    break;
+                }
+            } else if (diff < 0) {
+                // 受信者がまだ取り出していない（満杯）
+                overflows_.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            } else {
+                // 他の送信者に先を越された
+                pos = tail_.load(std::memory_order_relaxed);
+            }
+        }
+
+        cell->value = value;
+        cell->seq.store(pos + 1, std::memory_order_release);
+        return true;
+    }
+
+    /// 先頭の要素を取り出す。受信者だけが呼び出せる
+    /// 空のとき、または先頭の書き込みが完了していないときは std::nullopt
+    std::optional<T> Pop() {
+        Cell& cell = cells_[head_ & (N - 1)];
+        const size_t seq = cell.seq.load(std::memory_order_acquire);
+        if (seq != head_ + 1) {
+            return std::nullopt;
+        }
+
+        T value = cell.value;
+        // 1周後の送信者がこのセルを使えるようにする
+        cell.seq.store(head_ + N, std::memory_order_release);
+        head_++;
+        return value;
+    }
+
+    /// 書き込み済みの要素がなければ true（受信者から呼び出す）
+    bool Empty() const {
+        return cells_[head_ & (N - 1)].seq.load(std::memory_order_acquire) != head_ + 1;
+    }
+
+    /// 格納されている要素数のおおよその値
+    size_t Size() const {
+        const size_t tail = tail_.load(std::memory_order_relaxed);
+        return tail > head_ ? tail - head_ : 0;
+    }
+
+    /// 満杯で追加できなかった回数
+    uint64_t Overflows() const {
+        return overflows_.load(std::memory_order_relaxed);
+    }
+
+    static constexpr size_t Capacity() { return N; }
+
+private:
+    struct Cell {
+        std::atomic<size_t> seq;
+        T value;
+    };
+
+    std::array<Cell, N> cells_;
+    /// 次に書き込む位置（送信者間で共有）
+    std::atomic<size_t> tail_{0};
+    /// 次に読み出す位置（受信者のみが更新）
+    size_t head_{0};
+    std::atomic<uint64_t> overflows_{0};
+};
@@ -102,6 +102,9 @@ namespace {
         msg.arg.window_close.layer_id = layer->ID();
         g_task_manager->SendMessage(task_id, msg);
     }
+
+    /// マウスカーソル。メインタスクだけが操作する
+    std::shared_ptr<Mouse> g_mouse;
 } // namespace
 
 void DrawMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position) {
@@ -179,21 +182,34 @@ void Mouse::SetPosition(Vector2D<int> pos) {
 
 void InitializeMouse() {
     auto mouse_window = std::make_shared<Window>(kMouseCursorWidth, kMouseCursorHeight, g_screen_config.pixel_format);
-    mouse_window->SetTransparentColor(kMouseTransparentColor);
+    // 透明な画素を下のレイヤーと重ねる
+    mouse_window->SetAlpha(true);
     DrawMouseCursor(mouse_window->Writer(), {0, 0});
 
     auto mouse_layer_id = g_layer_manager->NewLayer()
                               .SetWindow(mouse_window)
                               .ID();
 
-    auto mouse = std::make_shared<Mouse>(mouse_layer_id);
-    mouse->SetPosition({200, 200});
-    g_layer_manager->UpDown(mouse->LayerID(), std::numeric_limits<int>::max());
+    g_mouse = std::make_shared<Mouse>(mouse_layer_id);
+    g_mouse->SetPosition({200, 200});
+    g_layer_manager->UpDown(g_mouse->LayerID(), std::numeric_limits<int>::max());
 
     // 割り込みイベント登録
-    usb::HIDMouseDriver::default_observer = [mouse](uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
-        mouse->OnInterrupt(buttons, displacement_x, displacement_y);
+    // USBドライバはワーカタスクで動くので、レイヤの操作はメインタスクに任せる
+    usb::HIDMouseDriver::default_observer = [](uint8_t buttons, int8_t displacement_x, int8_t displacement_y) {
+        Message msg{Message::kMouseInput};
+        msg.arg.mouse_input.buttons = buttons;
+        msg.arg.mouse_input.displacement_x = displacement_x;
+        msg.arg.mouse_input.displacement_y = displacement_y;
+        __asm__("cli");
+        g_task_manager->SendMessage(kMainTaskID, msg);
+        __asm__("sti");
     };
 
     g_active_layer->SetMouseLayer(mouse_layer_id);
 }
+
+void ProcessMouseMessage(const Message& msg) {
+    const auto& input = msg.arg.mouse_input;
+    g_mouse->OnInterrupt(input.buttons, input.displacement_x, input.displacement_y);
+}
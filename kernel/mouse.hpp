@@ -3,10 +3,11 @@
 #include <memory>
 
 #include "graphics.hpp"
+#include "message.hpp"
 
 const int kMouseCursorWidth = 15;
 const int kMouseCursorHeight = 24;
-const PixelColor kMouseTransparentColor = {0, 0, 1};
+const PixelColor kMouseTransparentColor = {0, 0, 0, 0};
 
 void DrawMouseCursor(PixelWriter* pixel_writer, Vector2D<int> position);
 
@@ -27,4 +28,6 @@ private:
     uint8_t previous_buttons_{0};
 };
 
-void InitializeMouse();
\ No newline at end of file
+void InitializeMouse();
+/// USBドライバから届いたマウスの入力をメインタスクで処理する
+void ProcessMouseMessage(const Message& msg);
\ No newline at end of file
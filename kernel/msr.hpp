@@ -4,7 +4,11 @@
 
 #include <cstdint>
 
+/// TSCデッドラインモードにおけるLocal APICタイマの割り込み時刻
+static constexpr uint32_t kIA32_TSC_DEADLINE = 0x6e0;
 static constexpr uint32_t kIA32_EFER = 0xc0000080;
 static constexpr uint32_t kIA32_STAR = 0xc0000081;
 static constexpr uint32_t kIA32_LSTAR = 0xc0000082;
 static constexpr uint32_t kIA32_FMASK = 0xc0000084;
+/// FSセグメントのベースアドレス（スレッドローカル領域の基点）
+static constexpr uint32_t kIA32_FS_BASE = 0xc0000100;
@@ -143,7 +143,8 @@ namespace {
 
             // コピーオンライトでコピーされたページは必ず writable=1 になっている
             // -> アプリの機械語（.text）や読み込み専用データ（.rodata）が含まれるLOADセグメントが読み込まれたページの物理フレームは解放しない
-            if (entry.bits.writable) {
+            // カーネルと共有しているフレームも解放しない
+            if (entry.bits.writable && !entry.bits.shared) {
                 const auto entry_addr = reinterpret_cast<uintptr_t>(entry.Pointer());
                 const FrameID map_frame{entry_addr / kBytesPerFrame};
                 if (auto err = g_memory_manager->Free(map_frame, 1)) {
@@ -198,6 +199,23 @@ namespace {
         return SetPageContent(table[i].Pointer(), part - 1, addr, content);
     }
 
+    /// 指定アドレスに対応する最下層（ページテーブル）のエントリを探す
+    /// 大きなページ（2MiB, 1GiB）のエントリは下位の階層ページング構造を指さないので、そこで探索を止める
+    /// level : 見つかったエントリの階層（1なら4KiBページ）を格納する先
+    PageMapEntry* FindPageEntry(PageMapEntry* table, int part, LinearAddress4Level addr, int* level = nullptr) {
+        auto& entry = table[addr.Part(part)];
+        if (part == 1 || (entry.bits.present && entry.bits.huge_page)) {
+            if (level) {
+                *level = part;
+            }
+            return &entry;
+        }
+        if (!entry.bits.present) {
+            return nullptr;
+        }
+        return FindPageEntry(entry.Pointer(), part - 1, addr, level);
+    }
+
     /// 4KiBページをコピーして書き込み可でマップする
     Error CopyOnePage(uint64_t causal_addr) {
         auto [p, err] = NewPageMap();
@@ -236,6 +254,35 @@ Error SetupPageMaps(LinearAddress4Level addr, size_t num_4kpages, bool writable)
     return SetupPageMap(pml4_table, 4, addr, num_4kpages, writable).error;
 }
 
+Error MapSharedPages(LinearAddress4Level addr, uint64_t phys_addr, size_t num_4kpages, bool writable) {
+    auto pml4_table = reinterpret_cast<PageMapEntry*>(GetCR3());
+    for (size_t i = 0; i < num_4kpages; i++) {
+        const LinearAddress4Level page_addr{addr.value + 4096 * i};
+
+        PageMapEntry* table = pml4_table;
+        for (int level = 4; level > 1; level--) {
+            auto& entry = table[page_addr.Part(level)];
+            auto [child_map, err] = SetNewPageMapIfNotPresent(entry);
+            if (err) {
+                return err;
+            }
+            entry.bits.writable = 1;
+            entry.bits.user = 1;
+            table = child_map;
+        }
+
+        auto& entry = table[page_addr.Part(1)];
+        entry.data = 0;
+        entry.SetPointer(reinterpret_cast<PageMapEntry*>(phys_addr + 4096 * i));
+        entry.bits.present = 1;
+        entry.bits.writable = writable;
+        entry.bits.user = 1;
+        entry.bits.shared = 1;
+        InvalidateTLB(page_addr.value);
+    }
+    return MAKE_ERROR(Error::kSuccess);
+}
+
 /// アプリ用のページング構造を破棄（PML4より下層のページング構造を削除）
 Error CleanPageMaps(LinearAddress4Level addr) {
     auto pml4_table = reinterpret_cast<PageMapEntry*>(GetCR3());
@@ -274,12 +321,46 @@ Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start) {
     return MAKE_ERROR(Error::kSuccess);
 }
 
+namespace {
+    size_t CountPages(PageMapEntry* table, int page_map_level) {
+        size_t count = 0;
+        for (int i = 0; i < 512; i++) {
+            const auto& entry = table[i];
+            if (!entry.bits.present) {
+                continue;
+            }
+            if (page_map_level == 1) {
+                count += !entry.bits.shared;
+            } else {
+                count += CountPages(entry.Pointer(), page_map_level - 1);
+            }
+        }
+        return count;
+    }
+} // namespace
+
+size_t CountUserPages(PageMapEntry* pml4) {
+    size_t count = 0;
+    for (int i = 256; i < 512; i++) {
+        if (pml4[i].bits.present) {
+            count += CountPages(pml4[i].Pointer(), 3);
+        }
+    }
+    return count;
+}
+
 Error HandlePageFault(uint64_t error_code, uint64_t causal_addr) {
     auto& task = g_task_manager->CurrentTask();
+    task.Stats().page_faults++;
     const bool present = (error_code >> 0) & 1;
     const bool rw = (error_code >> 1) & 1;
     const bool user = (error_code >> 2) & 1;
     if (present && rw && user) { // ページは存在するが読み込み専用なのでユーザーモードの書き込みが失敗
+        // カーネルと共有している読み込み専用ページ（時刻情報ページなど）への書き込みは許さない
+        auto entry = FindPageEntry(reinterpret_cast<PageMapEntry*>(GetCR3()), 4, LinearAddress4Level{causal_addr});
+        if (entry && entry->bits.shared) {
+            return MAKE_ERROR(Error::kAlreadyAllocated);
+        }
         // コピーオンライト
         return CopyOnePage(causal_addr);
     } else if (present) { // ページは存在するがページレベルの権限違反により例外発生
@@ -300,3 +381,30 @@ Error HandlePageFault(uint64_t error_code, uint64_t causal_addr) {
     // アプリは事前にアドレス範囲を申告しておくことで、バグによるメモリ枯渇を防ぐ
     return MAKE_ERROR(Error::kIndexOutOfRange);
 }
+
+WithError<uint64_t> GetPhysicalAddress(uint64_t addr) {
+    const auto pml4 = reinterpret_cast<PageMapEntry*>(GetCR3());
+    const LinearAddress4Level laddr{addr};
+    int level = 1;
+    auto entry = FindPageEntry(pml4, 4, laddr, &level);
+    if (entry == nullptr || !entry->bits.present) {
+        // 書き込みによるページフォルトと同様にフレームを割り当てる
+        if (auto err = HandlePageFault(0b010, addr)) {
+            return {0, err};
+        }
+    } else if (level == 1 && !entry->bits.writable && !entry->bits.shared) {
+        if (auto err = CopyOnePage(addr)) {
+            return {0, err};
+        }
+        InvalidateTLB(addr);
+    }
+
+    entry = FindPageEntry(pml4, 4, laddr, &level);
+    if (entry == nullptr || !entry->bits.present) {
+        return {0, MAKE_ERROR(Error::kIndexOutOfRange)};
+    }
+    // 大きなページではページ内オフセットのビット数が多い（PATビットなどもオフセット側に含めて落とす）
+    const uint64_t offset_mask = (uint64_t{4096} << (9 * (level - 1))) - 1;
+    const uint64_t frame = reinterpret_cast<uint64_t>(entry->Pointer()) & ~offset_mask;
+    return {frame + (addr & offset_mask), MAKE_ERROR(Error::kSuccess)};
+}
@@ -97,7 +97,11 @@ union PageMapEntry {
         uint64_t dirty : 1;
         uint64_t huge_page : 1;
         uint64_t global : 1;
-        uint64_t : 3;
+        /// OSが独自に使うビット（CPUは無視する）
+        /// カーネルと共有する物理フレーム : 1
+        /// アプリ終了時にフレームを解放せず、書き込みによるコピーオンライトも行わない
+        uint64_t shared : 1;
+        uint64_t : 2;
         /// 1つ下位の階層ページング構造の先頭アドレス
         uint64_t addr : 40;
         uint64_t : 12;
@@ -118,7 +122,13 @@ WithError<PageMapEntry*> NewPageMap();
 Error FreePageMap(PageMapEntry* table);
 Error SetupPageMaps(LinearAddress4Level addr, size_t num_4kpages, bool writable = true);
 Error CleanPageMaps(LinearAddress4Level addr);
+/// カーネルが確保済みの物理フレームをアプリのアドレス空間にマップする（共有ページ）
+/// phys_addr : マップする物理フレームの先頭アドレス（4KiB境界）
+Error MapSharedPages(LinearAddress4Level addr, uint64_t phys_addr, size_t num_4kpages, bool writable);
 Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start);
+/// 階層ページング構造のアプリ用の領域（上位半分）に割り当てられている物理フレームの数を数える
+/// カーネルと共有しているページは数えない
+size_t CountUserPages(PageMapEntry* pml4);
 /// デマンドページング : 初めはどのページに対してもフレームを割り当てないでおき、
 /// ページに初めてアクセスされたときにそのページだけフレームを割り当てる
 /// ページフォルトのエラーコードのビット定義 :
@@ -128,3 +138,8 @@ Error CopyPageMaps(PageMapEntry* dest, PageMapEntry* src, int part, int start);
 /// 2       | U/S   | 0 = スーパーバイザーモードのアクセス、1 = ユーザーモードのアクセス
 /// 3       | RSVD  | 0 = 予約ビットの違反が例外の原因ではない、1 = 予約ビットが1になっている
 Error HandlePageFault(uint64_t error_code, uint64_t causal_addr);
+
+/// 現在のアドレス空間の仮想アドレスに対応する物理アドレス
+/// フレームが未割り当てなら割り当て、コピーオンライトのページは複製してアプリ専用のフレームにしておく
+/// （後から書き込まれても物理アドレスが変わらないようにするため）
+WithError<uint64_t> GetPhysicalAddress(uint64_t addr);
@@ -0,0 +1,143 @@
+#include "pipe.hpp"
+
+#include <algorithm>
+#include <cstring>
+
+#include "poll.hpp"
+#include "task.hpp"
+
+static_assert((kPipeBufferBytes & (kPipeBufferBytes - 1)) == 0,
+              "kPipeBufferBytes must be a power of 2");
+
+Pipe::Pipe() : buf_(kPipeBufferBytes) {}
+
+size_t Pipe::Read(void* buf, size_t len) {
+    if (len == 0) {
+        return 0;
+    }
+
+    __asm__("cli");
+    Task& task = g_task_manager->CurrentTask();
+    // 割り込みを禁止してから状態を確かめるので、確かめてから眠るまでの間の起床を取りこぼさない
+    while (Used() == 0) {
+        if (write_closed_ || task.ExitRequested()) {
+            __asm__("sti");
+            return 0;
+        }
+        waiters_.Add(task.ID());
+        task.Sleep();
+    }
+
+    // バッファの終端をまたぐ場合は2回に分けてコピーする
+    const size_t n = std::min(len, Used());
+    const size_t pos = head_ & (kPipeBufferBytes - 1);
+    const size_t first = std::min(n, kPipeBufferBytes - pos);
+    auto bufc = reinterpret_cast<uint8_t*>(buf);
+    memcpy(bufc, &buf_[pos], first);
+    memcpy(bufc + first, &buf_[0], n - first);
+    head_ += n;
+
+    // 空きを待つ書き込み側を起こす
+    waiters_.WakeAll();
+    __asm__("sti");
+    return n;
+}
+
+size_t Pipe::Write(const void* buf, size_t len) {
+    auto bufc = reinterpret_cast<const uint8_t*>(buf);
+    size_t written = 0;
+
+    __asm__("cli");
+    Task& task = g_task_manager->CurrentTask();
+    while (written < len) {
+        if (read_closed_ || task.ExitRequested()) {
+            break;
+        }
+        if (Free() == 0) {
+            waiters_.Add(task.ID());
+            task.Sleep();
+            continue;
+        }
+
+        const size_t n = std::min(len - written, Free());
+        const size_t pos = tail_ & (kPipeBufferBytes - 1);
+        const size_t first = std::min(n, kPipeBufferBytes - pos);
+        memcpy(&buf_[pos], bufc + written, first);
+        memcpy(&buf_[0], bufc + written + first, n - first);
+        tail_ += n;
+        written += n;
+
+        // データを待つ読み込み側を起こす
+        waiters_.WakeAll();
+    }
+    __asm__("sti");
+    return written;
+}
+
+void Pipe::CloseWrite() {
+    __asm__("cli");
+    write_closed_ = true;
+    waiters_.WakeAll();
+    __asm__("sti");
+}
+
+void Pipe::CloseRead() {
+    __asm__("cli");
+    read_closed_ = true;
+    waiters_.WakeAll();
+    __asm__("sti");
+}
+
+std::pair<const void*, size_t> Pipe::ReadableSpan() const {
+    const size_t pos = head_ & (kPipeBufferBytes - 1);
+    return {&buf_[pos], std::min(Used(), kPipeBufferBytes - pos)};
+}
+
+void Pipe::Consume(size_t len) {
+    __asm__("cli");
+    head_ += std::min(len, Used());
+    waiters_.WakeAll();
+    __asm__("sti");
+}
+
+int Pipe::Poll() const {
+    int revents = 0;
+    if (Used() > 0 || write_closed_) {
+        revents |= POLL_READABLE;
+    }
+    // 読み込み側が閉じていれば、書き込みはブロックせずに終わる
+    if (Free() > 0 || read_closed_) {
+        revents |= POLL_WRITABLE;
+    }
+    return revents;
+}
+
+PipeDescriptor::PipeDescriptor(std::shared_ptr<Pipe> pipe) : pipe_{std::move(pipe)} {}
+
+size_t PipeDescriptor::Read(void* buf, size_t len) {
+    return pipe_->Read(buf, len);
+}
+
+size_t PipeDescriptor::Write(const void* buf, size_t len) {
+    return pipe_->Write(buf, len);
+}
+
+int PipeDescriptor::Poll() {
+    return pipe_->Poll();
+}
+
+WaitQueue* PipeDescriptor::PollWaitQueue() {
+    return &pipe_->Waiters();
+}
+
+std::pair<const void*, size_t> PipeDescriptor::ReadableSpan() {
+    return pipe_->ReadableSpan();
+}
+
+void PipeDescriptor::Consume(size_t len) {
+    pipe_->Consume(len);
+}
+
+void PipeDescriptor::FinishWrite() {
+    pipe_->CloseWrite();
+}
@@ -0,0 +1,76 @@
+/// タスク間でバイト列を受け渡すパイプ
+
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+#include "file.hpp"
+#include "wait_queue.hpp"
+
+/// パイプのバッファの大きさ（2のべき乗）
+const size_t kPipeBufferBytes = 64 * 1024;
+
+/// 固定長のリングバッファで書き込み側と読み込み側をつなぐカーネルオブジェクト
+/// バッファが満杯なら書き込み側を、空なら読み込み側を眠らせる（背圧）
+class Pipe {
+public:
+    Pipe();
+    Pipe(const Pipe&) = delete;
+    Pipe& operator=(const Pipe&) = delete;
+
+    /// 最大 len バイト読み込む。データが届くまで眠る
+    /// 書き込み側が閉じられていて、残りのデータもなければ 0 を返す
+    size_t Read(void* buf, size_t len);
+    /// len バイトすべて書き込むまで、空きができるのを待ちながら書き込む
+    /// 途中で読み込み側が閉じられたら、そこまでに書き込めたバイト数を返す
+    size_t Write(const void* buf, size_t len);
+
+    /// これ以上書き込まないことを読み込み側に伝える
+    void CloseWrite();
+    /// これ以上読み込まないことを書き込み側に伝える
+    void CloseRead();
+
+    /// バッファ上で連続している読み込み待ちのデータ。空なら大きさ0
+    std::pair<const void*, size_t> ReadableSpan() const;
+    /// ReadableSpan() の先頭 len バイトを読んだことにして、書き込み側を起こす
+    void Consume(size_t len);
+
+    /// POLL_READABLE, POLL_WRITABLE の組み合わせ
+    int Poll() const;
+    /// 読み込み側・書き込み側・Poll で待つタスクの待機キュー
+    WaitQueue& Waiters() { return waiters_; }
+
+private:
+    size_t Used() const { return tail_ - head_; }
+    size_t Free() const { return kPipeBufferBytes - Used(); }
+
+    std::vector<uint8_t> buf_;
+    /// 次に読み込む位置と次に書き込む位置（単調増加し、バッファの大きさで割った余りを使う）
+    size_t head_{0}, tail_{0};
+    bool write_closed_{false}, read_closed_{false};
+    WaitQueue waiters_{};
+};
+
+/// パイプの一端をファイルディスクリプタに見せかける
+class PipeDescriptor : public IFileDescriptor {
+public:
+    explicit PipeDescriptor(std::shared_ptr<Pipe> pipe);
+    size_t Read(void* buf, size_t len) override;
+    size_t Write(const void* buf, size_t len) override;
+    size_t Size() const override { return 0; }
+    size_t Load(void* buf, size_t len, size_t offset) override { return 0; }
+    /// データがあるか書き込み側が閉じていれば読み込める。空きがあれば書き込める
+    int Poll() override;
+    WaitQueue* PollWaitQueue() override;
+    std::pair<const void*, size_t> ReadableSpan() override;
+    void Consume(size_t len) override;
+
+    /// パイプは普通のファイルと違って末尾がないため、データがこれ以上存在しないことを伝える別の方法がこれ
+    void FinishWrite();
+
+private:
+    std::shared_ptr<Pipe> pipe_;
+};
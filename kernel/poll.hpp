@@ -0,0 +1,30 @@
+/// 複数のファイルディスクリプタとイベントキューをまとめて待つための定義
+/// アプリからも読み込まれる
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 読み込める（ブロックせずに Read できる）
+#define POLL_READABLE 0x01
+/// 書き込める
+#define POLL_WRITABLE 0x04
+/// 無効なファイルディスクリプタ
+#define POLL_INVALID 0x20
+
+/// fd にこの値を指定すると、アプリのイベントキュー（SyscallReadEvent）を待つ
+#define POLL_EVENT_FD (-2)
+
+struct PollFd {
+    int fd;
+    /// 待つ状態
+    short events;
+    /// 満たされた状態（カーネルが書き込む）
+    short revents;
+};
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -0,0 +1,124 @@
+#include "region.hpp"
+
+#include <algorithm>
+
+void SubtractRect(const Rectangle<int>& a, const Rectangle<int>& b, std::vector<Rectangle<int>>& out) {
+    const auto inter = a & b;
+    if (IsEmpty(inter)) {
+        out.push_back(a);
+        return;
+    }
+
+    const auto a_end = a.pos + a.size;
+    const auto inter_end = inter.pos + inter.size;
+    // 上下は a の幅いっぱい、左右は共通部分の高さだけの帯に分ける
+    if (a.pos.y < inter.pos.y) {
+        out.push_back({a.pos, {a.size.x, inter.pos.y - a.pos.y}});
+    }
+    if (inter_end.y < a_end.y) {
+        out.push_back({{a.pos.x, inter_end.y}, {a.size.x, a_end.y - inter_end.y}});
+    }
+    if (a.pos.x < inter.pos.x) {
+        out.push_back({{a.pos.x, inter.pos.y}, {inter.pos.x - a.pos.x, inter.size.y}});
+    }
+    if (inter_end.x < a_end.x) {
+        out.push_back({{inter_end.x, inter.pos.y}, {a_end.x - inter_end.x, inter.size.y}});
+    }
+}
+
+void Region::Add(const Rectangle<int>& rect) {
+    if (IsEmpty(rect)) {
+        return;
+    }
+
+    // 既にある矩形と重なる部分を削ってから加える
+    std::vector<Rectangle<int>> pieces{rect}, rest;
+    for (const auto& r : rects_) {
+        rest.clear();
+        for (const auto& p : pieces) {
+            SubtractRect(p, r, rest);
+        }
+        pieces.swap(rest);
+        if (pieces.empty()) {
+            return;
+        }
+    }
+    rects_.insert(rects_.end(), pieces.begin(), pieces.end());
+    Coalesce();
+
+    if (rects_.size() > kMaxRects) {
+        const auto bounds = Bounds();
+        rects_.assign(1, bounds);
+    }
+}
+
+void Region::Subtract(const Rectangle<int>& rect) {
+    if (IsEmpty(rect)) {
+        return;
+    }
+    std::vector<Rectangle<int>> rest;
+    for (const auto& r : rects_) {
+        SubtractRect(r, rect, rest);
+    }
+    rects_.swap(rest);
+    Coalesce();
+}
+
+Region Region::Intersection(const Rectangle<int>& rect) const {
+    // 互いに重ならない矩形をそれぞれ切り取るだけなので、結果も重ならない
+    Region result;
+    for (const auto& r : rects_) {
+        const auto inter = r & rect;
+        if (!IsEmpty(inter)) {
+            result.rects_.push_back(inter);
+        }
+    }
+    return result;
+}
+
+Rectangle<int> Region::Bounds() const {
+    if (rects_.empty()) {
+        return {{0, 0}, {0, 0}};
+    }
+    auto begin = rects_[0].pos;
+    auto end = rects_[0].pos + rects_[0].size;
+    for (const auto& r : rects_) {
+        begin = ElementMin(begin, r.pos);
+        end = ElementMax(end, r.pos + r.size);
+    }
+    return {begin, end - begin};
+}
+
+long Region::Area() const {
+    long area = 0;
+    for (const auto& r : rects_) {
+        area += static_cast<long>(r.size.x) * r.size.y;
+    }
+    return area;
+}
+
+void Region::Coalesce() {
+    // まとめると新たにまとめられる組ができることがあるので、変化がなくなるまで繰り返す
+    bool merged = true;
+    while (merged) {
+        merged = false;
+        for (size_t i = 0; i < rects_.size() && !merged; i++) {
+            for (size_t j = i + 1; j < rects_.size(); j++) {
+                auto& a = rects_[i];
+                const auto& b = rects_[j];
+                const bool same_columns = a.pos.x == b.pos.x && a.size.x == b.size.x;
+                const bool same_rows = a.pos.y == b.pos.y && a.size.y == b.size.y;
+                if (same_columns && (a.pos.y + a.size.y == b.pos.y || b.pos.y + b.size.y == a.pos.y)) {
+                    a = {{a.pos.x, std::min(a.pos.y, b.pos.y)}, {a.size.x, a.size.y + b.size.y}};
+                } else if (same_rows && (a.pos.x + a.size.x == b.pos.x || b.pos.x + b.size.x == a.pos.x)) {
+                    a = {{std::min(a.pos.x, b.pos.x), a.pos.y}, {a.size.x + b.size.x, a.size.y}};
+                } else {
+                    continue;
+                }
+                rects_.erase(rects_.begin() + j);
+                merged = true;
+                break;
+            }
+        }
+    }
+}
@@ -0,0 +1,43 @@
+/// 重なりのない矩形の集まりで表す画面上の領域
+
+#pragma once
+
+#include <vector>
+
+#include "graphics.hpp"
+
+/// 互いに重ならない矩形の集まり
+/// 追加するたびに、隣り合って1つの矩形にまとめられるものはまとめる
+class Region {
+public:
+    /// 矩形の数がこれを超えたら、全体を囲む1つの矩形にまとめる
+    static const size_t kMaxRects = 32;
+
+    /// 矩形を加える。既にある部分と重なる部分は加えない
+    void Add(const Rectangle<int>& rect);
+    /// 矩形と重なる部分を取り除く
+    void Subtract(const Rectangle<int>& rect);
+    /// 矩形と重なる部分だけを取り出した領域
+    Region Intersection(const Rectangle<int>& rect) const;
+    void Clear() { rects_.clear(); }
+    bool Empty() const { return rects_.empty(); }
+    const std::vector<Rectangle<int>>& Rects() const { return rects_; }
+    /// すべての矩形を囲む最小の矩形
+    Rectangle<int> Bounds() const;
+    /// 含まれる画素の数
+    long Area() const;
+
+private:
+    /// 辺を共有して1つの矩形にできる組をまとめる
+    void Coalesce();
+
+    std::vector<Rectangle<int>> rects_{};
+};
+
+/// 矩形が画素を1つも含まない -> true
+inline bool IsEmpty(const Rectangle<int>& rect) {
+    return rect.size.x <= 0 || rect.size.y <= 0;
+}
+
+/// a から b を取り除いた部分を、最大4つの重ならない矩形として out に加える
+void SubtractRect(const Rectangle<int>& a, const Rectangle<int>& b, std::vector<Rectangle<int>>& out);
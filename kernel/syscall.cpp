@@ -1,20 +1,27 @@
 #include "syscall.hpp"
 
+#include <algorithm>
 #include <array>
 #include <cerrno>
 #include <cmath>
 #include <cstdint>
 #include <fcntl.h>
+#include <limits>
 
 #include "app_event.hpp"
 #include "asmfunc.h"
+#include "compositor.hpp"
 #include "font.hpp"
+#include "futex.hpp"
+#include "io_ring.hpp"
 #include "keyboard.hpp"
 #include "logger.hpp"
 #include "msr.hpp"
 #include "task.hpp"
 #include "terminal.hpp"
+#include "thread.hpp"
 #include "timer.hpp"
+#include "win_surface.hpp"
 
 namespace syscall {
     /// システムコールの戻り値型
@@ -73,10 +80,20 @@ namespace syscall {
     /// アプリ終了
     /// arg1 : 終了時コード
     SYSCALL(Exit) {
+        const int exit_code = arg1;
         __asm__("cli");
         auto& task = g_task_manager->CurrentTask();
+        // スレッドから呼ばれたら、そのスレッドだけでなくアプリ全体を終了させる
+        // メインスレッドに終了を要求すれば、残りのスレッドはアプリの後片付けで終了させられる
+        const uint64_t main_thread = task.Space()->main_thread;
+        if (main_thread != task.ID()) {
+            if (Task* main_task = g_task_manager->FindTask(main_thread)) {
+                main_task->RequestExit(exit_code);
+                g_task_manager->Wakeup(main_task);
+            }
+        }
         __asm__("sti");
-        return {task.OSStackPointer(), static_cast<int>(arg1)};
+        return {task.OSStackPointer(), exit_code};
     }
 
     /// ウィンドウを開く
@@ -94,8 +111,9 @@ namespace syscall {
         g_active_layer->Activate(layer_id);
 
         // アプリのウィンドウに入力したキーがターミナルタスクに送信されるようにする
-        const auto task_id = g_task_manager->CurrentTask().ID();
-        g_layer_task_map->insert(std::make_pair(layer_id, task_id));
+        auto& task = g_task_manager->CurrentTask();
+        g_layer_task_map->insert(std::make_pair(layer_id, task.ID()));
+        task.Space()->windows.push_back(layer_id);
         __asm__("sti");
 
         return {layer_id, 0};
@@ -164,6 +182,120 @@ namespace syscall {
             arg1);
     }
 
+    /// 指定ウィンドウの指定範囲だけを再描画
+    /// SyscallWinMapSurface() でマップした領域に直接書き込んだあと、書き込んだ範囲を知らせるのに使う
+    /// arg1 : レイヤID（上位32bitは無視する）
+    /// arg2, arg3 : 範囲の左上（ウィンドウの左上が基準）
+    /// arg4, arg5 : 範囲の幅と高さ
+    SYSCALL(WinRedrawArea) {
+        const unsigned int layer_id = arg1 & 0xffffffff;
+        const int x = arg2, y = arg3, w = arg4, h = arg5;
+        if (w < 0 || h < 0) {
+            return {0, EINVAL};
+        }
+
+        __asm__("cli");
+        auto layer = g_layer_manager->FindLayer(layer_id);
+        if (layer == nullptr) {
+            __asm__("sti");
+            return {0, EBADF};
+        }
+        g_layer_manager->Draw(layer_id, {{x, y}, {w, h}});
+        __asm__("sti");
+        return {0, 0};
+    }
+
+    /// ウィンドウの描画内容を保持する領域を、アプリのアドレス空間に書き込み可でマップする
+    /// 同じウィンドウを再びマップしようとすると、前回と同じアドレスを返す
+    /// マップできるのはアプリ自身が開いたウィンドウだけ
+    /// arg1 : レイヤID（上位32bitは無視する）
+    /// arg2 : struct WinSurface の格納先
+    /// 戻り値 : マップした領域の先頭アドレス
+    SYSCALL(WinMapSurface) {
+        // OS側のメモリ（仮想アドレス空間の前半部）が指定されていたらエラーにする
+        if (arg2 < 0x8000000000000000) {
+            return {0, EFAULT};
+        }
+        const unsigned int layer_id = arg1 & 0xffffffff;
+        auto surface = reinterpret_cast<WinSurface*>(arg2);
+
+        __asm__("cli");
+        auto& task = g_task_manager->CurrentTask();
+        auto layer = g_layer_manager->FindLayer(layer_id);
+        if (layer == nullptr) {
+            __asm__("sti");
+            return {0, EBADF};
+        }
+        AppSpace& space = *task.Space();
+        // ターミナルやマウスカーソル、他のアプリのウィンドウなど、カーネルが描くウィンドウには書き込ませない
+        const auto owner = g_layer_task_map->find(layer_id);
+        const bool owned =
+            owner != g_layer_task_map->end() &&
+            (owner->second == space.main_thread ||
+             std::find(space.threads.begin(), space.threads.end(), owner->second) != space.threads.end()) &&
+            std::find(space.windows.begin(), space.windows.end(), layer_id) != space.windows.end();
+        if (!owned) {
+            __asm__("sti");
+            return {0, EPERM};
+        }
+        const auto window = layer->GetWindow();
+        const FrameBuffer& buffer = window->Surface();
+        const size_t num_pages = buffer.BufferBytes() / 4096;
+
+        uint64_t vaddr_begin = 0;
+        for (const auto& m : space.surfaces) {
+            if (m.window == window) {
+                vaddr_begin = m.vaddr;
+            }
+        }
+        const bool mapped = vaddr_begin != 0;
+        if (!mapped) {
+            vaddr_begin = task.FileMapEnd() - 4096 * num_pages;
+            if (num_pages == 0 || vaddr_begin < task.DPagingEnd()) {
+                __asm__("sti");
+                return {0, ENOMEM};
+            }
+            task.SetFileMapEnd(vaddr_begin);
+            space.surfaces.push_back(SurfaceMapping{window, vaddr_begin});
+        }
+        __asm__("sti");
+
+        // カーネルの領域は物理アドレスと同じ仮想アドレスでマップされているので、バッファのアドレスをそのまま使える
+        const auto& config = buffer.Config();
+        if (!mapped) {
+            const auto phys_addr = reinterpret_cast<uint64_t>(config.frame_buffer);
+            if (auto err = MapSharedPages(LinearAddress4Level{vaddr_begin}, phys_addr, num_pages, true)) {
+                return {0, ENOMEM};
+            }
+        }
+
+        surface->pixels = reinterpret_cast<uint32_t*>(vaddr_begin);
+        surface->width = config.horizontal_resolution;
+        surface->height = config.vertical_resolution;
+        surface->stride = config.pixels_per_scan_line;
+        surface->format = config.pixel_format == kPixelRGBResv8BitPerColor ? WIN_SURFACE_RGB : WIN_SURFACE_BGR;
+        return {vaddr_begin, 0};
+    }
+
+    /// 次にフレームを画面へ反映したとき、AppEvent::kFrame を受け取るよう要求する
+    /// アニメーションは、このイベントを受け取るたびに1フレーム描画すれば画面の更新と同期する
+    /// arg1 : レイヤID（上位32bitは無視する）
+    SYSCALL(WinRequestFrame) {
+        const unsigned int layer_id = arg1 & 0xffffffff;
+        __asm__("cli");
+        auto layer = g_layer_manager->FindLayer(layer_id);
+        if (layer == nullptr) {
+            __asm__("sti");
+            return {0, EBADF};
+        }
+        const auto err = RequestFrame(g_task_manager->CurrentTask().ID(), layer_id);
+        __asm__("sti");
+        if (err) {
+            return {0, EAGAIN};
+        }
+        return {0, 0};
+    }
+
     /// 指定ウィンドウの指定の2点間に直線を引く
     SYSCALL(WinDrawLine) {
         return DoWinFunc(
@@ -217,6 +349,41 @@ namespace syscall {
             arg1, arg2, arg3, arg4, arg5, arg6);
     }
 
+    /// ウィンドウの指定領域に画素を並べた配列を書き込む
+    /// arg2, arg3 : 書き込み先の左上の座標
+    /// arg4, arg5 : 幅と高さ
+    /// arg6 : 0x00RRGGBB 形式の画素を幅×高さ個並べた配列（アプリのウィンドウは不透明なので AA は無視する）
+    SYSCALL(WinBlit) {
+        // 幅と高さの上限。行の添字の計算（行番号 × 幅）が int に収まるようにする
+        const int kMaxBlitSize = 0x10000;
+        const int w = arg4, h = arg5;
+        if (w < 0 || kMaxBlitSize < w || h < 0 || kMaxBlitSize < h) {
+            return {0, EINVAL};
+        }
+        // 配列全体がアプリ用の領域（仮想アドレス空間の後半部）に収まっていなければエラーにする
+        const uint64_t bytes = sizeof(uint32_t) * static_cast<uint64_t>(w) * h;
+        if (arg6 < 0x8000000000000000 || std::numeric_limits<uint64_t>::max() - arg6 < bytes) {
+            return {0, EFAULT};
+        }
+
+        return DoWinFunc(
+            [](Window& win, int x, int y, int w, int h, const uint32_t* pixels) {
+                // ウィンドウからはみ出す部分は書き込まない
+                const int64_t x_begin = std::max<int64_t>(0, -static_cast<int64_t>(x));
+                const int64_t x_end = std::min<int64_t>(w, static_cast<int64_t>(win.Width()) - x);
+                const int64_t y_begin = std::max<int64_t>(0, -static_cast<int64_t>(y));
+                const int64_t y_end = std::min<int64_t>(h, static_cast<int64_t>(win.Height()) - y);
+                if (x_begin < x_end && y_begin < y_end) {
+                    const size_t offset = static_cast<size_t>(y_begin) * w + x_begin;
+                    win.Writer()->BlitRect({static_cast<int>(x + x_begin), static_cast<int>(y + y_begin)},
+                                           {static_cast<int>(x_end - x_begin), static_cast<int>(y_end - y_begin)},
+                                           &pixels[offset], w);
+                }
+                return Result{0, 0};
+            },
+            arg1, arg2, arg3, arg4, arg5, reinterpret_cast<const uint32_t*>(arg6));
+    }
+
     /// 指定レイヤのウィンドウを削除
     SYSCALL(CloseWindow) {
         const unsigned int layer_id = arg1 & 0xffffffff;
@@ -224,6 +391,10 @@ namespace syscall {
         if (err.Cause() == Error::kNoSuchEntry) {
             return {EBADF, 0};
         }
+        __asm__("cli");
+        auto& windows = g_task_manager->CurrentTask().Space()->windows;
+        windows.erase(std::remove(windows.begin(), windows.end(), layer_id), windows.end());
+        __asm__("sti");
         return {0, 0};
     }
 
@@ -241,6 +412,10 @@ namespace syscall {
         // 実行中のタスク -> ターミナルタスク
         auto& task = g_task_manager->CurrentTask();
         __asm__("sti");
+        // ウィンドウやキー入力のイベントはメインスレッド（ターミナルタスク）にだけ届く
+        if (task.Space()->main_thread != task.ID()) {
+            return {0, EINVAL};
+        }
         size_t i = 0;
 
         while (i < len) {
@@ -248,6 +423,11 @@ namespace syscall {
             // アプリに対するキー入力はターミナルタスクのメッセージキューから受け取る
             auto msg = task.ReceiveMessage();
             if (!msg && i == 0) {
+                // 終了を要求されたら、待つのをやめてシステムコールから戻る
+                if (task.ExitRequested()) {
+                    __asm__("sti");
+                    return {0, EINTR};
+                }
                 task.Sleep();
                 continue;
             }
@@ -304,6 +484,13 @@ namespace syscall {
                 app_events[i].type = AppEvent::kQuit;
                 i++;
                 break;
+            case Message::kFrame:
+                app_events[i].type = AppEvent::kFrame;
+                app_events[i].arg.frame.layer_id = msg->arg.frame.layer_id;
+                app_events[i].arg.frame.time_ns = msg->arg.frame.time_ns;
+                app_events[i].arg.frame.sequence = msg->arg.frame.sequence;
+                i++;
+                break;
             default:
                 Log(kInfo, "uncaught event type: %u\n", msg->type);
                 break;
@@ -313,6 +500,141 @@ namespace syscall {
         return {i, 0};
     }
 
+    namespace {
+        /// SyscallReadEvent() でアプリに渡されるメッセージか
+        bool IsAppEvent(const Message& msg) {
+            switch (msg.type) {
+            case Message::kKeyPush:
+            case Message::kMouseMove:
+            case Message::kMouseButton:
+            case Message::kWindowClose:
+            case Message::kFrame:
+                return true;
+            case Message::kTimerTimeout:
+                return msg.arg.timer.value < 0;
+            default:
+                return false;
+            }
+        }
+
+        /// メッセージキューの先頭にある、どの読み出し方でも使われないカーネル内部のメッセージを捨てる
+        /// アプリのイベントは、今回の Poll で待っていなくても後で ReadEvent で読まれるので残しておく
+        void DropIgnoredMessages(Task& task) {
+            while (auto msg = task.PeekMessage()) {
+                // 標準入力の Read() が使うメッセージ
+                if (msg->type == Message::kKeyPush && msg->arg.keyboard.press) {
+                    return;
+                }
+                if (IsAppEvent(*msg)) {
+                    return;
+                }
+                task.ReceiveMessage();
+            }
+        }
+    } // namespace
+
+    /// 複数のファイルディスクリプタとイベントキューのどれかが準備できるまで待つ
+    /// arg1 fds : struct PollFd の配列。fd に POLL_EVENT_FD を指定するとイベントキューを待つ
+    /// arg2 nfds : 配列の要素数
+    /// arg3 timeout_ms : 待つ最大のミリ秒数。0なら待たずに調べるだけ、-1なら無期限
+    /// 戻り値 : revents が0でない要素の数
+    SYSCALL(Poll) {
+        const size_t kMaxPollFds = 64;
+        auto user_fds = reinterpret_cast<PollFd*>(arg1);
+        const size_t nfds = arg2;
+        const uint64_t timeout_ms = arg3;
+        if (nfds > kMaxPollFds) {
+            return {0, EINVAL};
+        }
+        // OS側のメモリ（仮想アドレス空間の前半部）が指定されていたらエラーにする
+        if (arg1 < 0x8000000000000000) {
+            return {0, EFAULT};
+        }
+
+        // 割り込みを禁止している間にページフォルトを起こさないよう、カーネルの領域に写しておく
+        std::array<PollFd, kMaxPollFds> fds;
+        std::array<std::shared_ptr<IFileDescriptor>, kMaxPollFds> files;
+        __asm__("cli");
+        auto& task = g_task_manager->CurrentTask();
+        __asm__("sti");
+        for (size_t i = 0; i < nfds; i++) {
+            fds[i] = user_fds[i];
+            const int fd = fds[i].fd;
+            if (0 <= fd && fd < task.Files().size()) {
+                files[i] = task.Files()[fd];
+            }
+            // イベントはメインスレッドにだけ届くので、他のスレッドでは待てない
+            if (fd == POLL_EVENT_FD && task.Space()->main_thread != task.ID()) {
+                return {0, EINVAL};
+            }
+        }
+
+        unsigned long deadline = kNoTimeout;
+        if (timeout_ms < kNoTimeout / kTimerFreq) {
+            deadline = g_timer_manager->CurrentTick() + timeout_ms * kTimerFreq / 1000;
+        }
+        TimerHandle timer = 0;
+        size_t num_ready;
+
+        __asm__("cli");
+        while (true) {
+            DropIgnoredMessages(task);
+            num_ready = 0;
+            for (size_t i = 0; i < nfds; i++) {
+                int revents;
+                if (fds[i].fd == POLL_EVENT_FD) {
+                    auto msg = task.PeekMessage();
+                    revents = msg && IsAppEvent(*msg) ? POLL_READABLE : 0;
+                } else if (!files[i]) {
+                    revents = POLL_INVALID;
+                } else {
+                    revents = files[i]->Poll();
+                }
+                fds[i].revents = revents & (fds[i].events | POLL_INVALID);
+                if (fds[i].revents) {
+                    num_ready++;
+                }
+            }
+            if (num_ready > 0 || g_timer_manager->CurrentTick() >= deadline
+                || task.ExitRequested()) {
+                break;
+            }
+
+            if (timer == 0 && deadline != kNoTimeout) {
+                auto [handle, err] = g_timer_manager->AddTimer(Timer{deadline, kTimerWakeup, task.ID()});
+                if (err) {
+                    break;
+                }
+                timer = handle;
+                // 登録する直前に期限を過ぎていた場合、タイマはこの場で起こしてしまうので調べ直す
+                if (g_timer_manager->CurrentTick() >= deadline) {
+                    break;
+                }
+            }
+            // 自分宛てのメッセージは届いた時点で起こされるので、それ以外の待機キューに登録する
+            for (size_t i = 0; i < nfds; i++) {
+                if (files[i] && files[i]->PollWaitQueue()) {
+                    files[i]->PollWaitQueue()->Add(task.ID());
+                }
+            }
+            task.Sleep();
+            for (size_t i = 0; i < nfds; i++) {
+                if (files[i] && files[i]->PollWaitQueue()) {
+                    files[i]->PollWaitQueue()->Remove(task.ID());
+                }
+            }
+        }
+        if (timer) {
+            g_timer_manager->CancelTimer(timer);
+        }
+        __asm__("sti");
+
+        for (size_t i = 0; i < nfds; i++) {
+            user_fds[i].revents = fds[i].revents;
+        }
+        return {num_ready, 0};
+    }
+
     /// タイマ生成
     SYSCALL(CreateTimer) {
         const unsigned int mode = arg1;
@@ -330,16 +652,186 @@ namespace syscall {
                         // 現在時刻を基準としてarg3 msec後にタイムアウト
             timeout += g_timer_manager->CurrentTick();
         }
+        // periodic
+        // arg3 msecごとにタイムアウトを繰り返す
+        const unsigned long period = (mode & 2) ? std::max(1ul, arg3 * kTimerFreq / 1000) : 0;
 
         __asm__("cli");
         // 符号を反転しているのはOSとアプリのタイマを区別するため
         // ターミナルタスクにはカーソル点滅タイマの通知が常に送られてくるので、アプリのタイマ値とだぶっても大丈夫なようにしている
-        g_timer_manager->AddTimer(Timer{timeout, -timer_value, task_id});
+        auto [handle, err] = g_timer_manager->AddTimer(Timer{timeout, -timer_value, task_id, period});
         __asm__("sti");
+        if (err) {
+            return {0, EAGAIN};
+        }
 
         return {timeout * 1000 / kTimerFreq, 0};
     }
 
+    /// タイマの取り消し
+    /// 指定した値で生成したタイマをすべて取り消し、取り消した数を返す
+    SYSCALL(CancelTimer) {
+        const int timer_value = arg1;
+        if (timer_value <= 0) {
+            return {0, EINVAL};
+        }
+
+        __asm__("cli");
+        const uint64_t task_id = g_task_manager->CurrentTask().ID();
+        const auto num_canceled = g_timer_manager->CancelTimersIf([task_id, timer_value](const Timer& t) {
+            return t.TaskID() == task_id && t.Value() == -timer_value;
+        });
+        __asm__("sti");
+
+        return {num_canceled, 0};
+    }
+
+    /// 時計の種類（newlibのCLOCK_REALTIME / CLOCK_MONOTONICと同じ値）
+    /// 日時を知る手段がないので、どちらも起動からの経過時間を返す
+    const int kClockRealtime = 1;
+    const int kClockMonotonic = 4;
+
+    /// 指定した時計の現在時刻（ナノ秒）を取得
+    SYSCALL(ClockGetTime) {
+        const int clock_id = arg1;
+        if (clock_id != kClockRealtime && clock_id != kClockMonotonic) {
+            return {0, EINVAL};
+        }
+        return {NowNanoseconds(), 0};
+    }
+
+    /// 起床してから実行されるまでの待ち時間の分布を取得
+    /// arg1 : 0なら優先度別、1ならタスク別
+    /// arg2 : 優先度またはタスクID
+    /// arg3 : 各バケットの回数を格納する配列。バケットiは [2^(i-1), 2^i) µs（i=0は1µs未満）
+    /// arg4 : 配列の要素数
+    /// 戻り値 : 格納したバケットの数
+    SYSCALL(GetLatencyHistogram) {
+        const int kind = arg1;
+        const uint64_t target = arg2;
+        uint64_t* counts = reinterpret_cast<uint64_t*>(arg3);
+        const size_t len = std::min<size_t>(arg4, LatencyHistogram::kNumBuckets);
+        // OS側のメモリ（仮想アドレス空間の前半部）が指定されていたらエラーにする
+        if (arg3 < 0x8000000000000000) {
+            return {0, EFAULT};
+        }
+
+        LatencyHistogram hist;
+        __asm__("cli");
+        if (kind == 0 && target <= TaskManager::kMaxLevel) {
+            hist = g_task_manager->LevelLatency(target);
+        } else if (kind == 1) {
+            Task* task = g_task_manager->FindTask(target);
+            if (task == nullptr) {
+                __asm__("sti");
+                return {0, ESRCH};
+            }
+            hist = task->WakeupLatency();
+        } else {
+            __asm__("sti");
+            return {0, EINVAL};
+        }
+        __asm__("sti");
+
+        for (size_t i = 0; i < len; i++) {
+            counts[i] = hist.Buckets()[i];
+        }
+        return {len, 0};
+    }
+
+    /// スレッドを作る
+    /// arg1 : スレッドの開始アドレス。(0, arg) を引数として呼び出される
+    /// arg2 arg : 開始アドレスに渡す値
+    /// 戻り値 : スレッドID（タスクID）
+    SYSCALL(CreateThread) {
+        auto [tid, err] = CreateAppThread(arg1, arg2);
+        if (err.Cause() == Error::kNoEnoughMemory) {
+            return {0, ENOMEM};
+        } else if (err) {
+            return {0, EINVAL};
+        }
+        return {tid, 0};
+    }
+
+    /// 呼び出したスレッドを終了する
+    /// メインスレッドから呼び出した場合は、他のスレッドがすべて終了してからアプリを終了する
+    /// arg1 : 終了コード
+    SYSCALL(ExitThread) {
+        __asm__("cli");
+        auto& task = g_task_manager->CurrentTask();
+        __asm__("sti");
+        if (task.Space()->main_thread == task.ID()) {
+            JoinAllAppThreads(task);
+        }
+        // 待っている間に他のスレッドが exit() を呼んだら、その終了コードでアプリを終了する
+        __asm__("cli");
+        const int exit_code = task.ExitRequested() ? task.RequestedExitCode() : static_cast<int>(arg1);
+        __asm__("sti");
+        return {task.OSStackPointer(), exit_code};
+    }
+
+    /// 同じアプリのスレッドの終了を待つ
+    /// arg1 : スレッドID
+    /// 戻り値 : スレッドの終了コード
+    SYSCALL(JoinThread) {
+        auto [exit_code, err] = JoinAppThread(arg1);
+        switch (err.Cause()) {
+        case Error::kSuccess:
+            break;
+        case Error::kBusy:
+            return {0, EBUSY};
+        case Error::kInterrupted:
+            return {0, EINTR};
+        default:
+            return {0, ESRCH};
+        }
+        return {static_cast<uint64_t>(exit_code), 0};
+    }
+
+    /// *addr が expected と等しければ、FutexWake で起こされるまで眠る
+    /// arg1 addr : 4byte境界の32bit値のアドレス
+    /// arg2 expected : 眠る条件となる値
+    /// arg3 timeout_ms : タイムアウトまでのミリ秒数。-1なら無期限
+    SYSCALL(FutexWait) {
+        const uint64_t addr = arg1;
+        const uint32_t expected = arg2;
+        const uint64_t timeout_ms = arg3;
+        unsigned long timeout = kNoTimeout;
+        if (timeout_ms < kNoTimeout / kTimerFreq) {
+            timeout = timeout_ms * kTimerFreq / 1000;
+        }
+
+        auto err = ::FutexWait(addr, expected, timeout);
+        switch (err.Cause()) {
+        case Error::kSuccess:
+            return {0, 0};
+        case Error::kValueChanged:
+            return {0, EAGAIN};
+        case Error::kTimeout:
+            return {0, ETIMEDOUT};
+        case Error::kInterrupted:
+            return {0, EINTR};
+        case Error::kInvalidFormat:
+            return {0, EINVAL};
+        default:
+            return {0, EFAULT};
+        }
+    }
+
+    /// addr で待機しているスレッドを起こす
+    /// arg1 addr : FutexWait に指定したアドレス
+    /// arg2 n : 起こすスレッドの最大数
+    /// 戻り値 : 起こしたスレッドの数
+    SYSCALL(FutexWake) {
+        auto [num_woken, err] = ::FutexWake(arg1, static_cast<int>(arg2));
+        if (err.Cause() == Error::kInvalidFormat) {
+            return {0, EINVAL};
+        } else if (err) {
+            return {0, EFAULT};
+        }
+        return {static_cast<uint64_t>(num_woken), 0};
+    }
+
     namespace {
         /// Task::files_の空き要素を返す
         size_t AllocateFD(Task& task) {
@@ -422,6 +914,30 @@ namespace syscall {
         return {task.Files()[fd]->Read(buf, count), 0};
     }
 
+    /// ファイルディスクリプタ間でデータを転送する。読み込み元の領域から直接書き込むので、アプリのバッファを経由しない
+    /// arg1 fd_out : 書き込み先
+    /// arg2 fd_in : 読み込み元
+    /// arg3 count : 転送する最大バイト数。読み込み元が終端に達したら、そこで終わる
+    /// 戻り値 : 転送したバイト数
+    SYSCALL(Splice) {
+        const int fd_out = arg1;
+        const int fd_in = arg2;
+        const size_t count = arg3;
+        __asm__("cli");
+        auto& task = g_task_manager->CurrentTask();
+        __asm__("sti");
+
+        auto& files = task.Files();
+        if (fd_out < 0 || files.size() <= fd_out || !files[fd_out] ||
+            fd_in < 0 || files.size() <= fd_in || !files[fd_in]) {
+            return {0, EBADF};
+        }
+        // 転送中にファイルディスクリプタが閉じられても、実体を解放しないよう参照を保持しておく
+        auto out = files[fd_out];
+        auto in = files[fd_in];
+        return {::Splice(*out, *in, count), 0};
+    }
+
     /// デマンドページング可能なアドレス範囲を拡大
     /// このシステムコールは、アプリ側にはメモリ確保と同義
     SYSCALL(DemandPages) {
@@ -459,6 +975,151 @@ namespace syscall {
         task.FileMaps().push_back(FileMapping{fd, vaddr_begin, vaddr_end});
         return {vaddr_begin, 0};
     }
+    /// 要求・完了リングを作り、アプリのアドレス空間にマップする
+    /// 戻り値 : リング（struct IoRing）のアドレス。作成済みなら同じアドレスを返す
+    SYSCALL(IoRingSetup) {
+        __asm__("cli");
+        auto& task = g_task_manager->CurrentTask();
+        AppSpace& space = *task.Space();
+        if (space.io_ring != 0) {
+            __asm__("sti");
+            return {space.io_ring, 0};
+        }
+
+        const size_t num_pages = (sizeof(IoRing) + 4095) / 4096;
+        const uint64_t vaddr_begin = task.FileMapEnd() - 4096 * num_pages;
+        if (vaddr_begin < task.DPagingEnd()) {
+            __asm__("sti");
+            return {0, ENOMEM};
+        }
+        task.SetFileMapEnd(vaddr_begin);
+        // 他のスレッドが同時に呼び出しても1つのリングだけを作るよう、割り込みを禁止している間に場所を確保する
+        space.io_ring = vaddr_begin;
+        __asm__("sti");
+
+        if (auto err = SetupPageMaps(LinearAddress4Level{vaddr_begin}, num_pages)) {
+            __asm__("cli");
+            space.io_ring = 0;
+            // 後から他の領域が確保されていなければ、切り出したアドレス範囲も戻す
+            if (task.FileMapEnd() == vaddr_begin) {
+                task.SetFileMapEnd(vaddr_begin + 4096 * num_pages);
+            }
+            __asm__("sti");
+            return {0, ENOMEM};
+        }
+        memset(reinterpret_cast<void*>(vaddr_begin), 0, sizeof(IoRing));
+        return {vaddr_begin, 0};
+    }
+
+    namespace {
+        bool IsWindowOp(uint32_t opcode) {
+            return opcode == IO_OP_WIN_WRITE_STRING || opcode == IO_OP_WIN_FILL_RECTANGLE ||
+                   opcode == IO_OP_WIN_REDRAW || opcode == IO_OP_WIN_DRAW_LINE ||
+                   opcode == IO_OP_WIN_BLIT;
+        }
+
+        /// 要求に対応するシステムコールを実行する
+        Result DispatchIoRingOp(const IoRingSqe& sqe) {
+            const auto& a = sqe.args;
+            auto call = [&a](auto f) { return f(a[0], a[1], a[2], a[3], a[4], a[5]); };
+            switch (sqe.opcode) {
+            case IO_OP_PUT_STRING:
+                return call(PutString);
+            case IO_OP_WIN_WRITE_STRING:
+                return call(WinWriteString);
+            case IO_OP_WIN_FILL_RECTANGLE:
+                return call(WinFillRectangle);
+            case IO_OP_WIN_REDRAW:
+                return call(WinRedraw);
+            case IO_OP_WIN_DRAW_LINE:
+                return call(WinDrawLine);
+            case IO_OP_CREATE_TIMER:
+                return call(CreateTimer);
+            case IO_OP_READ_FILE:
+                return call(ReadFile);
+            case IO_OP_CANCEL_TIMER:
+                return call(CancelTimer);
+            case IO_OP_WIN_BLIT:
+                return call(WinBlit);
+            default:
+                return {0, EINVAL};
+            }
+        }
+    } // namespace
+
+    /// 要求リングに積まれた要求を先頭から処理し、結果を完了リングに書き込む
+    /// ウィンドウの再描画は要求ごとには行わず、最後にレイヤごとに1回だけ行う
+    /// arg1 to_submit : 処理する要求の最大数
+    /// 戻り値 : 処理した要求の数（完了リングが満杯になると途中で打ち切る）
+    SYSCALL(IoRingEnter) {
+        const uint32_t to_submit = arg1;
+        __asm__("cli");
+        auto& task = g_task_manager->CurrentTask();
+        __asm__("sti");
+        if (task.Space()->io_ring == 0) {
+            return {0, EINVAL};
+        }
+        auto ring = reinterpret_cast<IoRing*>(task.Space()->io_ring);
+
+        // 再描画が必要なレイヤ。入りきらなければその場で再描画する
+        std::array<unsigned int, 8> dirty_layers;
+        size_t num_dirty = 0;
+        auto mark_dirty = [&](unsigned int layer_id) {
+            for (size_t i = 0; i < num_dirty; i++) {
+                if (dirty_layers[i] == layer_id) {
+                    return;
+                }
+            }
+            if (num_dirty < dirty_layers.size()) {
+                dirty_layers[num_dirty++] = layer_id;
+                return;
+            }
+            __asm__("cli");
+            g_layer_manager->Draw(layer_id);
+            __asm__("sti");
+        };
+
+        uint32_t head = ring->sq_head;
+        const uint32_t tail = ring->sq_tail;
+        uint32_t submitted = 0;
+        while (submitted < to_submit && head != tail) {
+            if (ring->cq_tail - ring->cq_head >= IO_RING_CQ_ENTRIES) {
+                ring->cq_overflow++;
+                break;
+            }
+
+            // アプリが書き換えても影響しないよう、写しを使う
+            IoRingSqe sqe = ring->sqes[head % IO_RING_SQ_ENTRIES];
+            if (IsWindowOp(sqe.opcode)) {
+                const uint64_t no_redraw = 1ull << 32;
+                if ((sqe.args[0] & no_redraw) == 0) {
+                    mark_dirty(sqe.args[0] & 0xffffffff);
+                }
+                sqe.args[0] |= no_redraw;
+            }
+
+            const Result res = DispatchIoRingOp(sqe);
+            if (res.error != 0 || (sqe.flags & IO_SQE_SKIP_SUCCESS) == 0) {
+                IoRingCqe& cqe = ring->cqes[ring->cq_tail % IO_RING_CQ_ENTRIES];
+                cqe.user_data = sqe.user_data;
+                cqe.value = res.value;
+                cqe.error = res.error;
+                __asm__ volatile("" ::: "memory");
+                ring->cq_tail++;
+            }
+
+            head++;
+            ring->sq_head = head;
+            submitted++;
+        }
+
+        for (size_t i = 0; i < num_dirty; i++) {
+            __asm__("cli");
+            g_layer_manager->Draw(dirty_layers[i]);
+            __asm__("sti");
+        }
+        return {submitted, 0};
+    }
 #undef SYSCALL
 
 } // namespace syscall
@@ -468,7 +1129,7 @@ using SyscallFuncType = syscall::Result(uint64_t, uint64_t, uint64_t, uint64_t,
 
 /// システムコールの（関数ポインタ）テーブル
 /// この添字に0x80000000を足した値をシステムコール番号とする
-extern "C" std::array<SyscallFuncType*, 0x10> g_syscall_table{
+extern "C" std::array<SyscallFuncType*, kNumSyscalls> g_syscall_table{
     /* 0x00 */ syscall::LogString,
     /* 0x01 */ syscall::PutString,
     /* 0x02 */ syscall::Exit,
@@ -485,6 +1146,22 @@ extern "C" std::array<SyscallFuncType*, 0x10> g_syscall_table{
     /* 0x0d */ syscall::ReadFile,
     /* 0x0e */ syscall::DemandPages,
     /* 0x0f */ syscall::MapFile,
+    /* 0x10 */ syscall::CancelTimer,
+    /* 0x11 */ syscall::ClockGetTime,
+    /* 0x12 */ syscall::GetLatencyHistogram,
+    /* 0x13 */ syscall::CreateThread,
+    /* 0x14 */ syscall::ExitThread,
+    /* 0x15 */ syscall::JoinThread,
+    /* 0x16 */ syscall::FutexWait,
+    /* 0x17 */ syscall::FutexWake,
+    /* 0x18 */ syscall::IoRingSetup,
+    /* 0x19 */ syscall::IoRingEnter,
+    /* 0x1a */ syscall::WinBlit,
+    /* 0x1b */ syscall::Poll,
+    /* 0x1c */ syscall::Splice,
+    /* 0x1d */ syscall::WinRequestFrame,
+    /* 0x1e */ syscall::WinMapSurface,
+    /* 0x1f */ syscall::WinRedrawArea,
 };
 
 void InitializeSyscall() {
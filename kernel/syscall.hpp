@@ -1,3 +1,8 @@
 #pragma once
 
+#include <cstddef>
+
+/// システムコールの数（システムコールテーブルの要素数）
+constexpr size_t kNumSyscalls = 0x20;
+
 void InitializeSyscall();
\ No newline at end of file
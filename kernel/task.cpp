@@ -1,22 +1,56 @@
 #include "task.hpp"
 
 #include "asmfunc.h"
+#include "futex.hpp"
+#include "paging.hpp"
 #include "segment.hpp"
 #include "timer.hpp"
 
 namespace {
-    template <class T, class U>
-    void Erase(T& c, const U& value) {
-        auto it = std::remove(c.begin(), c.end(), value);
-        c.erase(it, c.end());
-    }
-
     void TaskIdle(uint64_t task_id, int64_t data) {
         while (true) __asm__("hlt");
     }
 } // namespace
 
-Task::Task(uint64_t id) : id_{id} {}
+void RunQueue::PushBack(Task* task) {
+    task->run_prev_ = tail_;
+    task->run_next_ = nullptr;
+    if (tail_) {
+        tail_->run_next_ = task;
+    } else {
+        head_ = task;
+    }
+    tail_ = task;
+    size_++;
+}
+
+void RunQueue::PushFront(Task* task) {
+    task->run_prev_ = nullptr;
+    task->run_next_ = head_;
+    if (head_) {
+        head_->run_prev_ = task;
+    } else {
+        tail_ = task;
+    }
+    head_ = task;
+    size_++;
+}
+
+void RunQueue::PopFront() {
+    Erase(head_);
+}
+
+void RunQueue::Erase(Task* task) {
+    if (task == nullptr || (task != head_ && task->run_prev_ == nullptr)) {
+        return;
+    }
+    (task->run_prev_ ? task->run_prev_->run_next_ : head_) = task->run_next_;
+    (task->run_next_ ? task->run_next_->run_prev_ : tail_) = task->run_prev_;
+    task->run_prev_ = task->run_next_ = nullptr;
+    size_--;
+}
+
+Task::Task(uint64_t id) : id_{id}, space_{std::make_shared<AppSpace>()} {}
 
 Task& Task::InitContext(TaskFunc* f, int64_t data) {
     const size_t stack_size = kDefaultStackBytes / sizeof(stack_[0]);
@@ -35,7 +69,8 @@ Task& Task::InitContext(TaskFunc* f, int64_t data) {
     context_.rdi = id_;
     context_.rsi = data;
 
-    // MXCSRのすべての例外をマスクする
+    // x87 FPUとMXCSRのすべての例外をマスクする
+    *reinterpret_cast<uint16_t*>(&context_.fxsave_area[0]) = 0x037f;
     *reinterpret_cast<uint32_t*>(&context_.fxsave_area[24]) = 0x1f80;
 
     return *this;
@@ -63,68 +98,135 @@ Task& Task::Wakeup() {
     return *this;
 }
 
-void Task::SendMessage(const Message& msg) {
-    msgs_.push_back(msg);
+Error Task::SendMessage(const Message& msg) {
+    if (!msgs_.Push(msg)) {
+        return MAKE_ERROR(Error::kFull);
+    }
     Wakeup();
+    message_waiters_.WakeAll();
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+void Task::SendMessageBlocking(const Message& msg) {
+    while (true) {
+        __asm__("cli");
+        if (!SendMessage(msg)) {
+            g_task_manager->CurrentTask().stats_.messages_sent++;
+            __asm__("sti");
+            return;
+        }
+
+        Task& sender = g_task_manager->CurrentTask();
+        // 自分自身を待つことはできない。終了を要求されたら送信をあきらめる
+        if (&sender == this || sender.ExitRequested()) {
+            __asm__("sti");
+            return;
+        }
+        // 受信側がメッセージを取り出すまで待つ
+        send_waiters_.Add(sender.ID());
+        sender.Sleep();
+        __asm__("sti");
+    }
 }
 
 std::optional<Message> Task::ReceiveMessage() {
-    if (msgs_.empty()) {
-        return std::nullopt;
+    std::optional<Message> msg;
+    if (peeked_) {
+        msg.swap(peeked_);
+    } else {
+        msg = PopMessage();
+    }
+    if (msg) {
+        stats_.messages_received++;
+    }
+    return msg;
+}
+
+std::optional<Message> Task::PeekMessage() {
+    if (!peeked_) {
+        peeked_ = PopMessage();
     }
+    return peeked_;
+}
+
+std::optional<Message> Task::PopMessage() {
     // メッセージキューからメッセージを取り出す
-    auto msg = msgs_.front();
-    msgs_.pop_front();
+    auto msg = msgs_.Pop();
+    if (msg && !send_waiters_.Empty()) {
+        // 空きができたので、送信を待っているタスクを起こす
+        send_waiters_.WakeAll();
+    }
     return msg;
 }
 
+uint64_t Task::DroppedMessages() const {
+    return msgs_.Overflows();
+}
+
+Task& Task::SetName(const char* name) {
+    strncpy(name_.data(), name, name_.size() - 1);
+    name_.back() = '\0';
+    return *this;
+}
+
 std::vector<std::shared_ptr<IFileDescriptor>>& Task::Files() {
-    return files_;
+    return space_->files;
 }
 
 uint64_t Task::DPagingBegin() const {
-    return dpaging_begin_;
+    return space_->dpaging_begin;
 }
 
 void Task::SetDPagingBegin(uint64_t v) {
-    dpaging_begin_ = v;
+    space_->dpaging_begin = v;
 }
 
 uint64_t Task::DPagingEnd() const {
-    return dpaging_end_;
+    return space_->dpaging_end;
 }
 
 void Task::SetDPagingEnd(uint64_t v) {
-    dpaging_end_ = v;
+    space_->dpaging_end = v;
 }
 
 uint64_t Task::FileMapEnd() const {
-    return file_map_end_;
+    return space_->file_map_end;
 }
 
 void Task::SetFileMapEnd(uint64_t v) {
-    file_map_end_ = v;
+    space_->file_map_end = v;
 }
 
 std::vector<FileMapping>& Task::FileMaps() {
-    return file_maps_;
+    return space_->file_maps;
+}
+
+Task& Task::SetSpace(std::shared_ptr<AppSpace> space) {
+    space_ = std::move(space);
+    return *this;
 }
 
 TaskManager::TaskManager() {
     // 最初に突っ込んでおくのは優先度最高のメインタスク
     // idは常に1
     Task& main_task = NewTask()
+                          .SetName("main")
                           .SetLevel(current_level_)
                           .SetRunning(true);
-    running_[current_level_].push_back(&main_task);
+    running_[current_level_].PushBack(&main_task);
+    // 起動直後のFPUの状態はメインタスクのもの
+    g_fpu_owner_ctx = &main_task.Context();
+    g_running_ctx = &main_task.Context();
 
     // アイドルタスク
     // すべてのタスクがスリープしてランキューが空になった場合の番兵となる
     Task& idle = NewTask()
                      .InitContext(TaskIdle, 0)
+                     .SetName("idle")
                      .SetLevel(0) // 最低の優先度
                      .SetRunning(true);
-    running_[0].push_back(&idle);
+    running_[0].PushBack(&idle);
+    dispatch_tsc_ = ReadTSC();
 }
 
 Task& TaskManager::NewTask() {
@@ -134,9 +236,19 @@ Task& TaskManager::NewTask() {
 
 void TaskManager::SwitchTask(const TaskContext& current_ctx) {
     TaskContext& task_ctx = g_task_manager->CurrentTask().Context();
-    memcpy(&task_ctx, &current_ctx, sizeof(TaskContext));
+    memcpy(&task_ctx, &current_ctx, offsetof(TaskContext, fxsave_area));
     Task* current_task = RotateCurrentRunQueue(false);
-    if (&CurrentTask() != current_task) {
+    // 実行中のタスクのままでも、終了させるためにコンテキストを書き換えたなら切り替える
+    const bool redirected = (task_ctx.cs & 0x3) != (current_ctx.cs & 0x3);
+    if (&CurrentTask() != current_task || redirected) {
+        // 割り込み時点でFPUを所有していたなら、その状態はスタック上に退避してある
+        if (current_ctx.fpu_saved) {
+            memcpy(&task_ctx.fxsave_area, &current_ctx.fxsave_area, sizeof(task_ctx.fxsave_area));
+        }
+        // ハンドラ内でFPUレジスタが書き換わっている可能性があるので、所有権を手放す
+        if (g_fpu_owner_ctx == &task_ctx) {
+            g_fpu_owner_ctx = nullptr;
+        }
         RestoreContext(&CurrentTask().Context());
     }
 }
@@ -147,15 +259,16 @@ void TaskManager::Sleep(Task* task) {
     }
 
     task->SetRunning(false);
+    task->wakeup_tsc_ = 0;
 
     // 指定のタスクが現在実行中の場合
-    if (task == running_[current_level_].front()) {
+    if (task == running_[current_level_].Front()) {
         Task* current_task = RotateCurrentRunQueue(true);
         SwitchContext(&CurrentTask().Context(), &current_task->Context());
         return;
     }
 
-    Erase(running_[task->Level()], task);
+    running_[task->Level()].Erase(task);
 }
 
 Error TaskManager::Sleep(uint64_t id) {
@@ -182,11 +295,13 @@ void TaskManager::Wakeup(Task* task, int level) {
 
     task->SetLevel(level);
     task->SetRunning(true);
+    task->wakeup_tsc_ = ReadTSC();
 
-    running_[level].push_back(task);
+    running_[level].PushBack(task);
     if (level > current_level_) {
         level_changed_ = true;
     }
+    UpdateSliceTimer(false);
     return;
 }
 
@@ -203,20 +318,61 @@ Error TaskManager::Wakeup(uint64_t id, int level) {
 }
 
 Error TaskManager::SendMessage(uint64_t id, const Message& msg) {
+    Task* task = FindTask(id);
+    if (task == nullptr) {
+        return MAKE_ERROR(Error::kNoSuchTask);
+    }
+
+    auto err = task->SendMessage(msg);
+    if (!err) {
+        CurrentTask().stats_.messages_sent++;
+    }
+    return err;
+}
+
+Task* TaskManager::FindTask(uint64_t id) {
     auto it = std::find_if(tasks_.begin(),
                            tasks_.end(),
                            [id](const auto& task) { return task->ID() == id; });
+    return it == tasks_.end() ? nullptr : it->get();
+}
 
-    if (it == tasks_.end()) {
-        return MAKE_ERROR(Error::kNoSuchTask);
+std::vector<TaskSnapshot> TaskManager::Snapshot() {
+    // 実行中のタスクの使用時間には、切り替えてからの経過時間を含める
+    const uint64_t now = ReadTSC();
+    Task* current_task = &CurrentTask();
+
+    std::vector<TaskSnapshot> snapshots;
+    for (const auto& task : tasks_) {
+        TaskSnapshot& s = snapshots.emplace_back();
+        s.id = task->ID();
+        s.level = task->Level();
+        s.running = task->Running();
+        s.name = task->name_;
+        s.stats = task->stats_;
+        s.dropped_messages = task->DroppedMessages();
+        // 実行中のタスクのCR3はコンテキストに保存されていない
+        const uint64_t cr3 = task.get() == current_task ? GetCR3() : task->Context().cr3;
+        s.resident_pages = CountUserPages(reinterpret_cast<PageMapEntry*>(cr3));
+        if (task.get() == current_task) {
+            s.stats.run_tsc += now - dispatch_tsc_;
+        }
+        s.wakeup_latency = task->wakeup_latency_;
     }
+    return snapshots;
+}
 
-    (*it)->SendMessage(msg);
-    return MAKE_ERROR(Error::kSuccess);
+void TaskManager::ResetLatency() {
+    for (auto& hist : level_latency_) {
+        hist.Reset();
+    }
+    for (const auto& task : tasks_) {
+        task->wakeup_latency_.Reset();
+    }
 }
 
 Task& TaskManager::CurrentTask() {
-    return *running_[current_level_].front();
+    return *running_[current_level_].Front();
 }
 
 void TaskManager::Finish(int exit_code) {
@@ -225,6 +381,13 @@ void TaskManager::Finish(int exit_code) {
 
     // 削除する前にidを保存
     const auto task_id = current_task->ID();
+    // 終了したタスク宛てのタイマを取り消す
+    g_timer_manager->CancelTimersIf([task_id](const Timer& t) { return t.TaskID() == task_id; });
+    // 削除するタスクのFPUの状態は以後不要
+    if (g_fpu_owner_ctx == &current_task->Context()) {
+        g_fpu_owner_ctx = nullptr;
+    }
+    g_running_ctx = nullptr;
     auto it = std::find_if(
         tasks_.begin(), tasks_.end(),
         [current_task](const auto& t) {
@@ -248,7 +411,16 @@ WithError<int> TaskManager::WaitFinish(uint64_t task_id) {
     int exit_code;
     // WaitFinish()をコールしたタスク
     Task* current_task = &CurrentTask();
+    if (auto it = finish_waiter_.find(task_id);
+        it != finish_waiter_.end() && it->second != current_task) {
+        return {0, MAKE_ERROR(Error::kBusy)};
+    }
     while (true) { // 指定タスクの終了を待機
+        // 終了を要求されたら、終了コードを受け取らずに戻る（他のタスクが代わりに受け取れる）
+        if (current_task->ExitRequested()) {
+            CancelWaitFinish(current_task);
+            return {0, MAKE_ERROR(Error::kInterrupted)};
+        }
         if (auto it = finish_tasks_.find(task_id); it != finish_tasks_.end()) {
             exit_code = it->second;
             finish_tasks_.erase(it);
@@ -260,6 +432,52 @@ WithError<int> TaskManager::WaitFinish(uint64_t task_id) {
     return {exit_code, MAKE_ERROR(Error::kSuccess)};
 }
 
+void TaskManager::CancelWaitFinish(Task* waiter) {
+    for (auto it = finish_waiter_.begin(); it != finish_waiter_.end();) {
+        if (it->second == waiter) {
+            it = finish_waiter_.erase(it);
+        } else {
+            ++it;
+        }
+    }
+}
+
+Error TaskManager::Kill(uint64_t id, int exit_code) {
+    Task* task = FindTask(id);
+    if (task == nullptr) {
+        return MAKE_ERROR(Error::kNoSuchTask);
+    }
+    if (task == &CurrentTask()) {
+        return MAKE_ERROR(Error::kInvalidTask);
+    }
+
+    if (task->Running()) {
+        running_[task->Level()].Erase(task);
+        if (running_[current_level_].Empty()) {
+            level_changed_ = true;
+        }
+    }
+    // 削除するタスクへの参照をすべて取り除く
+    g_timer_manager->CancelTimersIf([id](const Timer& t) { return t.TaskID() == id; });
+    CancelFutexWait(task);
+    if (g_fpu_owner_ctx == &task->Context()) {
+        g_fpu_owner_ctx = nullptr;
+    }
+    CancelWaitFinish(task);
+    auto it = std::find_if(tasks_.begin(), tasks_.end(),
+                           [task](const auto& t) { return t.get() == task; });
+    tasks_.erase(it);
+
+    finish_tasks_[id] = exit_code;
+    if (auto it = finish_waiter_.find(id); it != finish_waiter_.end()) {
+        auto waiter = it->second;
+        finish_waiter_.erase(it);
+        Wakeup(waiter);
+    }
+    UpdateSliceTimer(false);
+    return MAKE_ERROR(Error::kSuccess);
+}
+
 void TaskManager::ChangeLevelRunning(Task* task, int level) {
     // 実行レベル変更なし
     if (level < 0 || level == task->Level()) {
@@ -267,19 +485,20 @@ void TaskManager::ChangeLevelRunning(Task* task, int level) {
     }
 
     // change level of other task
-    if (task != running_[current_level_].front()) {
-        Erase(running_[task->Level()], task);
-        running_[level].push_back(task);
+    if (task != running_[current_level_].Front()) {
+        running_[task->Level()].Erase(task);
+        running_[level].PushBack(task);
         task->SetLevel(level);
         if (level > current_level_) {
             level_changed_ = true;
         }
+        UpdateSliceTimer(false);
         return;
     }
 
     // change level myself
-    running_[current_level_].pop_front();
-    running_[level].push_front(task);
+    running_[current_level_].PopFront();
+    running_[level].PushFront(task);
     task->SetLevel(level);
     if (level >= current_level_) {
         current_level_ = level;
@@ -287,16 +506,17 @@ void TaskManager::ChangeLevelRunning(Task* task, int level) {
         current_level_ = level;
         level_changed_ = true;
     }
+    UpdateSliceTimer(false);
 }
 
 Task* TaskManager::RotateCurrentRunQueue(bool current_sleep) {
     auto& level_queue = running_[current_level_];
-    Task* current_task = level_queue.front();
-    level_queue.pop_front();
+    Task* current_task = level_queue.Front();
+    level_queue.PopFront();
     if (!current_sleep) {
-        level_queue.push_back(current_task);
+        level_queue.PushBack(current_task);
     }
-    if (level_queue.empty()) {
+    if (level_queue.Empty()) {
         level_changed_ = true;
     }
 
@@ -305,28 +525,110 @@ Task* TaskManager::RotateCurrentRunQueue(bool current_sleep) {
         level_changed_ = false;
         // レベルの高い順から走査し、最初の空でない待機列のレベルで抜ける
         for (int lv = kMaxLevel; lv >= 0; lv--) {
-            if (!running_[lv].empty()) {
+            if (!running_[lv].Empty()) {
                 current_level_ = lv;
                 break;
             }
         }
     }
 
+    // 切り替え先のタスクに新しいタイムスライスを与える
+    UpdateSliceTimer(true);
+
+    // タスクごとの実行時間と切り替え回数を記録
+    if (&CurrentTask() != current_task) {
+        const uint64_t now = ReadTSC();
+        auto& stats = current_task->stats_;
+        stats.run_tsc += now - dispatch_tsc_;
+        if (current_sleep) {
+            stats.voluntary_switches++;
+        } else {
+            stats.involuntary_switches++;
+        }
+        dispatch_tsc_ = now;
+
+        // 起床してから実行されるまでの待ち時間を記録
+        Task& next = CurrentTask();
+        if (next.wakeup_tsc_ != 0) {
+            const uint64_t count = now - next.wakeup_tsc_;
+            const uint64_t us = count / g_tsc_freq * 1000000 + count % g_tsc_freq * 1000000 / g_tsc_freq;
+            next.wakeup_latency_.Record(us);
+            level_latency_[next.Level()].Record(us);
+            next.wakeup_tsc_ = 0;
+        }
+    }
+    RedirectToExit(CurrentTask());
     return current_task;
 }
 
+void TaskManager::RedirectToExit(Task& task) {
+    auto& ctx = task.context_;
+    // システムコールの途中で止めたタスクは、アプリに戻る時点で終了する
+    if (!task.exit_requested_ || (ctx.cs & 0x3) != 3) {
+        return;
+    }
+    // ExitApp() はスタックをOS用スタックポインタに切り替えて CallApp() から戻る
+    ctx.rip = reinterpret_cast<uint64_t>(ExitApp);
+    ctx.rdi = task.os_stack_pointer_;
+    ctx.rsi = static_cast<uint32_t>(task.exit_code_);
+    ctx.cs = kKernelCS;
+    ctx.ss = kKernelSS;
+    ctx.rsp = task.os_stack_pointer_;
+    ctx.rflags = 0x202;
+    task.in_app_ = false;
+}
+
+void TaskManager::UpdateSliceTimer(bool restart) {
+    // より優先度の高いタスクが起床した場合は、直ちにタスクを切り替える
+    if (level_changed_) {
+        g_timer_manager->SetSliceTimer(g_timer_manager->CurrentTick());
+        return;
+    }
+
+    // 同じ優先度のタスクが他にいなければ、タスクを切り替える必要はない
+    if (running_[current_level_].Size() <= 1) {
+        g_timer_manager->StopSliceTimer();
+        return;
+    }
+
+    if (restart || !g_timer_manager->SliceTimerActive()) {
+        g_timer_manager->SetSliceTimer(g_timer_manager->CurrentTick() + kTaskTimerPeriod);
+    }
+}
+
 TaskManager* g_task_manager;
+TaskContext* g_fpu_owner_ctx;
+TaskContext* g_running_ctx;
 
 void InitializeTask() {
     g_task_manager = new TaskManager;
+    // タスク切替え用のタイマは、同じ優先度のタスクが複数実行可能になったときに設定される
+}
 
-    // タスク切替え用のタイマ追加
-    __asm__("cli");
-    g_timer_manager->AddTimer(Timer{g_timer_manager->CurrentTick() + kTaskTimerPeriod, kTaskTimerValue, kMainTaskID});
-    __asm__("sti");
+/// システムコールの入口で呼び出される
+/// 呼び出し回数を数え、現在実行中のタスクのOS用スタックポインタの値を返す
+__attribute__((no_caller_saved_registers)) extern "C" uint64_t EnterSyscall(uint64_t syscall_number) {
+    Task& task = g_task_manager->CurrentTask();
+    task.SetInApp(false);
+    if (syscall_number < kNumSyscalls) {
+        task.Stats().syscalls[syscall_number]++;
+    }
+    return task.OSStackPointer();
 }
 
-/// 現在実行中のタスクのOS用スタックポインタの値を取得
-__attribute__((no_caller_saved_registers)) extern "C" uint64_t GetCurrentTaskOSStackPointer() {
-    return g_task_manager->CurrentTask().OSStackPointer();
+/// LeaveSyscall() の戻り値。RAX, RDX に入れて返される
+struct SyscallExit {
+    uint64_t os_stack_pointer;
+    int exit_code;
+};
+
+/// システムコールからアプリに戻る直前に呼び出される
+/// 終了を要求されていれば {OS用スタックポインタ, 終了コード} を返す。アプリに戻れるなら {0, 0}
+extern "C" SyscallExit LeaveSyscall() {
+    Task& task = g_task_manager->CurrentTask();
+    if (task.ExitRequested()) {
+        return {task.OSStackPointer(), task.RequestedExitCode()};
+    }
+    task.SetInApp(true);
+    return {0, 0};
 }
\ No newline at end of file
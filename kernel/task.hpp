@@ -5,28 +5,84 @@
 #include <array>
 #include <cstddef>
 #include <cstdint>
-#include <deque>
 #include <map>
+#include <memory>
 #include <optional>
 #include <vector>
 
 #include "error.hpp"
 #include "fat.hpp"
+#include "latency_histogram.hpp"
 #include "message.hpp"
+#include "message_queue.hpp"
+#include "syscall.hpp"
+#include "wait_queue.hpp"
 
 /// コンテキスト : タスクの実行バイナリ、コマンドライン引数、環境変数、スタックメモリ、各レジスタの値など
 /// コンテキストの切替時に値の保存と復帰に必要なレジスタをすべて含む
 struct TaskContext {
-    uint64_t cr3, rip, rflags, reserved;             // offset 0x00
+    uint64_t cr3, rip, rflags, fpu_saved;            // offset 0x00
     uint64_t cs, ss, fs, gs;                         // offset 0x20
     uint64_t rax, rbx, rcx, rdx, rdi, rsi, rsp, rbp; // offset 0x40
     uint64_t r8, r9, r19, r11, r12, r13, r14, r15;   // offset 0x80
     std::array<uint8_t, 512> fxsave_area;            // offset 0xc0
+    /// スレッドローカル領域の基点（IA32_FS_BASE MSR）
+    uint64_t fs_base;                                // offset 0x2c0
 } __attribute__((packed));
 
 using TaskFunc = void(uint64_t, int64_t);
 
+/// タスクごとの統計情報
+struct TaskStats {
+    /// CPUを使用した時間（TSCのカウント数）
+    uint64_t run_tsc;
+    /// 自分から眠ったことによるタスク切り替えの回数
+    uint64_t voluntary_switches;
+    /// タイムスライスの終了や優先度の変化によるタスク切り替えの回数
+    uint64_t involuntary_switches;
+    uint64_t page_faults;
+    uint64_t messages_sent, messages_received;
+    /// システムコール番号ごとの呼び出し回数
+    std::array<uint64_t, kNumSyscalls> syscalls;
+};
+
+/// ある時点でのタスクの状態（ps や top コマンドで表示する）
+struct TaskSnapshot {
+    uint64_t id;
+    int level;
+    bool running;
+    std::array<char, 16> name;
+    TaskStats stats;
+    uint64_t dropped_messages;
+    /// アプリ用に割り当てられている物理フレームの数
+    size_t resident_pages;
+    /// 起床してから実際に実行されるまでの待ち時間の分布
+    LatencyHistogram wakeup_latency;
+};
+
+class Task;
 class TaskManager;
+class Window;
+
+/// 同じ優先度の実行可能なタスクの待機列
+/// タスク自身が持つリンクでつなぐので、割り込みハンドラからタスクを起こしてもメモリを確保しない
+/// 1つのタスクが同時に並べる待機列は1つだけ
+class RunQueue {
+public:
+    bool Empty() const { return head_ == nullptr; }
+    size_t Size() const { return size_; }
+    Task* Front() const { return head_; }
+    void PushBack(Task* task);
+    void PushFront(Task* task);
+    void PopFront();
+    /// 並んでいるタスクを取り除く。並んでいなければ何もしない
+    void Erase(Task* task);
+
+private:
+    Task* head_{nullptr};
+    Task* tail_{nullptr};
+    size_t size_{0};
+};
 
 /// ファイルの内容を仮想アドレス空間の連続した領域にマッピング
 struct FileMapping {
@@ -36,6 +92,49 @@ struct FileMapping {
     uint64_t vaddr_begin, vaddr_end;
 };
 
+/// アプリのアドレス空間にマップしたウィンドウの描画領域
+struct SurfaceMapping {
+    /// マップしている間、描画領域が解放されないよう所有権をもつ
+    std::shared_ptr<Window> window;
+    uint64_t vaddr;
+};
+
+/// アプリの PT_TLS セグメントから得たスレッドローカル領域の雛形
+struct TLSTemplate {
+    /// 初期値（.tdata）の仮想アドレスとサイズ
+    uint64_t vaddr, filesz;
+    /// 0で初期化される部分（.tbss）を含めたサイズ
+    uint64_t memsz;
+    uint64_t align;
+};
+
+/// アプリのアドレス空間に付随する資源
+/// 同じアプリのスレッド（タスク）はこれを共有する
+struct AppSpace {
+    /// ファイルディスクリプタをアプリ毎に持たせる
+    /// -> 番号が他のアプリとだぶっても大丈夫
+    std::vector<std::shared_ptr<IFileDescriptor>> files{};
+    /// デマンドページングの仮想アドレス範囲
+    uint64_t dpaging_begin{0}, dpaging_end{0};
+    /// メモリマップドファイルやスレッドのスタックに利用される仮想アドレス範囲
+    uint64_t file_map_end{0};
+    std::vector<FileMapping> file_maps{};
+    TLSTemplate tls{};
+    /// 終了したスレッドが使っていたスタック領域の末尾アドレス（再利用する）
+    std::vector<uint64_t> free_stacks{};
+    /// アプリを起動したタスク（メインスレッド）のID
+    uint64_t main_thread{0};
+    /// メインスレッド以外のスレッドのタスクID
+    std::vector<uint64_t> threads{};
+    /// アプリが開いたウィンドウのレイヤID
+    std::vector<unsigned int> windows{};
+    /// 要求・完了リング（struct IoRing）の仮想アドレス。0なら未作成
+    uint64_t io_ring{0};
+    /// アドレス空間にマップしたウィンドウの描画領域
+    /// ウィンドウが閉じられても、アプリが終了するまでは領域を解放しない
+    std::vector<SurfaceMapping> surfaces{};
+};
+
 /// タスク : 動作中のプログラム。処理単位。
 class Task {
 public:
@@ -43,6 +142,8 @@ public:
     static const int kDefaultLevel = 1;
     /// 32KiB
     static const size_t kDefaultStackBytes = 8 * 4096;
+    /// メッセージキューに格納できるメッセージの数（2の累乗）
+    static const size_t kMessageQueueSize = 256;
 
     Task(uint64_t id);
     /// f : 実際に実行されるタスク（関数）
@@ -53,9 +154,26 @@ public:
     Task& Sleep();
     Task& Wakeup();
     /// イベントメッセージが通知されたら起こす
-    void SendMessage(const Message& msg);
+    /// 割り込みハンドラからも呼び出せる。キューが満杯ならメッセージを捨てて kFull を返す
+    Error SendMessage(const Message& msg);
+    /// キューに空きができるまで送信元のタスクを眠らせてから送信する
+    /// 割り込みハンドラからは呼び出せない。呼び出し時に割り込みを許可しておくこと
+    void SendMessageBlocking(const Message& msg);
     /// メッセージを取得
     std::optional<Message> ReceiveMessage();
+    /// 次に ReceiveMessage() で取得されるメッセージを、取り出さずに返す
+    /// 受信側のタスクから呼び出す
+    std::optional<Message> PeekMessage();
+    /// メッセージが届いたときに起こされる待機キュー（受信側以外のタスクが待つために使う）
+    WaitQueue& MessageWaiters() { return message_waiters_; }
+    /// キューが満杯で受け取れなかったメッセージの数
+    uint64_t DroppedMessages() const;
+    TaskStats& Stats() { return stats_; }
+    /// 起床してから実際に実行されるまでの待ち時間の分布
+    const LatencyHistogram& WakeupLatency() const { return wakeup_latency_; }
+    const char* Name() const { return name_.data(); }
+    /// 表示用の名前を設定する。長い名前は切り詰める
+    Task& SetName(const char* name);
     std::vector<std::shared_ptr<IFileDescriptor>>& Files();
     uint64_t DPagingBegin() const;
     void SetDPagingBegin(uint64_t v);
@@ -64,10 +182,36 @@ public:
     uint64_t FileMapEnd() const;
     void SetFileMapEnd(uint64_t v);
     std::vector<FileMapping>& FileMaps();
+    /// アプリのアドレス空間に付随する資源。スレッド間で共有される
+    const std::shared_ptr<AppSpace>& Space() const { return space_; }
+    Task& SetSpace(std::shared_ptr<AppSpace> space);
 
     int Level() const { return level_; }
     bool Running() const { return running_; }
 
+    /// 終了を要求する。要求されたタスクはシステムコールからアプリに戻る時点で終了する
+    /// 眠っているタスクは起こされて、待機を中断する
+    Task& RequestExit(int exit_code) {
+        exit_requested_ = true;
+        exit_code_ = exit_code;
+        return *this;
+    }
+    bool ExitRequested() const { return exit_requested_; }
+    /// アプリが終了した後、同じタスクで次のアプリを実行できるように要求を取り消す
+    Task& ClearExitRequest() {
+        exit_requested_ = false;
+        exit_code_ = 0;
+        return *this;
+    }
+    int RequestedExitCode() const { return exit_code_; }
+    /// アプリのコードを実行している（カーネル内の処理の途中ではない） : true
+    /// このときだけは、タスクを強制的に終了させても資源が中途半端な状態で残らない
+    bool InApp() const { return in_app_; }
+    Task& SetInApp(bool in_app) {
+        in_app_ = in_app;
+        return *this;
+    }
+
 private:
     uint64_t id_;
     /// スタック領域
@@ -76,18 +220,31 @@ private:
     /// OS用スタックポインタ（アプリ終了時からの復帰に必要）
     uint64_t os_stack_pointer_;
     /// 割り込みメッセージキュー
-    std::deque<Message> msgs_;
+    /// 割り込みハンドラがヒープを使わずに送信できるよう、領域は固定長で確保しておく
+    MPSCQueue<Message, kMessageQueueSize> msgs_;
+    /// PeekMessage() でキューから取り出したメッセージ
+    std::optional<Message> peeked_{};
+    /// メッセージキューの空きを待っているタスク
+    WaitQueue send_waiters_{};
+    WaitQueue message_waiters_{};
+    std::array<char, 16> name_{};
+    TaskStats stats_{};
+    /// 起床した時点のTSCの値。実行されるまでの待ち時間の計測に使い、実行されたら0に戻す
+    uint64_t wakeup_tsc_{0};
+    LatencyHistogram wakeup_latency_{};
     unsigned int level_{kDefaultLevel};
     /// 実行可能状態（待機列に並んでいる） : true
     bool running_{false};
-    /// ファイルディスクリプタをタスク毎に持たせる
-    /// -> 番号が他のタスクとだぶっても大丈夫
-    std::vector<std::shared_ptr<IFileDescriptor>> files_{};
-    /// デマンドページングの仮想アドレス範囲
-    uint64_t dpaging_begin_{0}, dpaging_end_{0};
-    /// メモリマップドファイルに利用される仮想アドレス範囲
-    uint64_t file_map_end_{0};
-    std::vector<FileMapping> file_maps_{};
+    bool in_app_{false};
+    bool exit_requested_{false};
+    int exit_code_{0};
+    /// RunQueue でつながっている前後のタスク
+    Task* run_prev_{nullptr};
+    Task* run_next_{nullptr};
+    std::shared_ptr<AppSpace> space_;
+
+    /// メッセージキューから取り出し、空きを待っている送信元を起こす
+    std::optional<Message> PopMessage();
 
     Task& SetLevel(int level) {
         level_ = level;
@@ -99,6 +256,7 @@ private:
     }
 
     friend TaskManager;
+    friend RunQueue;
 };
 
 /// 複数のタスクを管理
@@ -123,7 +281,21 @@ public:
     /// 現在実行中のタスクを終了し、finish_tasks_に終了コードを登録
     void Finish(int exit_code);
     /// 指定タスクの終了コードを得る
+    /// 1つのタスクの終了を待てるのは1つのタスクだけ。他のタスクが既に待っていれば kBusy を返す
+    /// 待っている間に終了を要求されたら kInterrupted を返す
     WithError<int> WaitFinish(uint64_t task_id);
+    /// 指定のタスクによる WaitFinish() の待機を取り消す
+    void CancelWaitFinish(Task* waiter);
+    /// 実行中でないタスクを強制的に終了させる。終了コードは WaitFinish() で得られる
+    Error Kill(uint64_t id, int exit_code);
+    /// 指定のIDのタスク。なければ nullptr
+    Task* FindTask(uint64_t id);
+    /// 全タスクの状態と統計情報を集める。割り込みを禁止して呼び出すこと
+    std::vector<TaskSnapshot> Snapshot();
+    /// 指定の優先度のタスクが起床してから実行されるまでの待ち時間の分布
+    const LatencyHistogram& LevelLatency(int level) const { return level_latency_[level]; }
+    /// 待ち時間の記録をすべて消去する
+    void ResetLatency();
 
 private:
     /// タスク一覧
@@ -134,11 +306,15 @@ private:
     /// 優先度別のタスクの待機列（ランキュー）
     /// 先頭を現在実行中のタスクとする
     /// あるタスクより優先度の低いタスクは、そのタスクがスリープするか同じ優先度まで下がらない限り実行されない
-    std::array<std::deque<Task*>, kMaxLevel + 1> running_{};
+    std::array<RunQueue, kMaxLevel + 1> running_{};
     /// 現在実行中のタスクが属する優先度
     int current_level_{kMaxLevel};
     /// 次回のタスク切替え時に現在の実行レベルを変更 : true
     bool level_changed_{false};
+    /// 現在実行中のタスクに切り替えた時点のTSCの値
+    uint64_t dispatch_tsc_{0};
+    /// 優先度ごとの、起床してから実行されるまでの待ち時間の分布
+    std::array<LatencyHistogram, kMaxLevel + 1> level_latency_{};
     /// 終了されたタスク一覧
     /// key: ID of a finished task
     /// value: exit code
@@ -151,9 +327,20 @@ private:
     void ChangeLevelRunning(Task* task, int level);
     /// ランキューの先頭要素を末尾に移動
     Task* RotateCurrentRunQueue(bool current_sleep);
+    /// アプリのコードの途中で止めたタスクが終了を要求されていたら、再開したときに ExitApp() へ進むよう
+    /// コンテキストを書き換える（割り込みの境界での終了）
+    void RedirectToExit(Task& task);
+    /// ランキューの状態に応じてタイムスライスの終了時刻を設定し直す
+    /// restart : 実行中のタスクに新しいタイムスライスを与える
+    void UpdateSliceTimer(bool restart);
 };
 
 extern TaskManager* g_task_manager;
+/// FPU/SSEレジスタに状態が読み込まれているタスクのコンテキスト。nullptrなら誰のものでもない
+/// このタスク以外に切り替えるときはCR0.TSを立て、FPUが使われた時点で #NM 例外のハンドラが入れ替える
+extern "C" TaskContext* g_fpu_owner_ctx;
+/// 実行中のタスクのコンテキスト。#NM 例外のハンドラが読み込む先
+extern "C" TaskContext* g_running_ctx;
 constexpr uint64_t kMainTaskID = 1;
 
 void InitializeTask();
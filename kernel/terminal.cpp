@@ -4,17 +4,86 @@
 
 #include "../MikanLoaderPkg/elf.h"
 #include "asmfunc.h"
+#include "compositor.hpp"
 #include "font.hpp"
 #include "keyboard.hpp"
 #include "layer.hpp"
 #include "memory_manager.hpp"
+#include "msr.hpp"
 #include "paging.hpp"
 #include "pci.hpp"
+#include "thread.hpp"
 #include "timer.hpp"
 
 #include "logger.hpp"
 
 namespace {
+    /// タスクごとの統計情報を1行ずつ表示する
+    /// prev : 前回集めた情報。CPU使用率は前回からの差分で求める（空なら起動時から）
+    /// verbose : メッセージ数とよく呼ばれたシステムコールも表示する
+    void PrintTaskSnapshots(IFileDescriptor& fd,
+                            const std::vector<TaskSnapshot>& snapshots,
+                            const std::vector<TaskSnapshot>& prev,
+                            bool verbose) {
+        auto prev_run_tsc = [&prev](uint64_t id) -> uint64_t {
+            for (const auto& p : prev) {
+                if (p.id == id) {
+                    return p.stats.run_tsc;
+                }
+            }
+            return 0;
+        };
+
+        uint64_t total_tsc = 0;
+        for (const auto& s : snapshots) {
+            total_tsc += s.stats.run_tsc - prev_run_tsc(s.id);
+        }
+        if (total_tsc == 0) {
+            total_tsc = 1;
+        }
+
+        PrintToFD(fd, "%3s %2s %c %-8s %5s %5s %5s %5s %5s %5s %5s\n",
+                  "ID", "LV", 'S', "NAME", "CPU%", "TIME", "VCSW", "ICSW", "PFLT", "SYSC", "RES");
+        for (const auto& s : snapshots) {
+            // CPU使用率（0.1%単位）
+            const uint64_t permille = (s.stats.run_tsc - prev_run_tsc(s.id)) * 1000 / total_tsc;
+            uint64_t syscalls = 0;
+            for (auto n : s.stats.syscalls) {
+                syscalls += n;
+            }
+            PrintToFD(fd, "%3lu %2d %c %-8.8s %3lu.%lu %5lu %5lu %5lu %5lu %5lu %5lu\n",
+                      s.id, s.level, s.running ? 'R' : 'S', s.name.data(),
+                      permille / 10, permille % 10,
+                      s.stats.run_tsc / g_tsc_freq,
+                      s.stats.voluntary_switches, s.stats.involuntary_switches,
+                      s.stats.page_faults, syscalls, s.resident_pages);
+            if (!verbose) {
+                continue;
+            }
+
+            PrintToFD(fd, "    msg %lu/%lu drop %lu",
+                      s.stats.messages_sent, s.stats.messages_received, s.dropped_messages);
+            // 呼び出し回数の多いシステムコールを3つまで表示
+            auto calls = s.stats.syscalls;
+            for (int i = 0; i < 3; i++) {
+                auto it = std::max_element(calls.begin(), calls.end());
+                if (*it == 0) {
+                    break;
+                }
+                PrintToFD(fd, " 0x%02lx:%lu", it - calls.begin(), *it);
+                *it = 0;
+            }
+            PrintToFD(fd, "\n");
+        }
+    }
+
+    /// 待ち時間の分布の要約（回数、パーセンタイル、最大値）を1行で表示する
+    void PrintLatencySummary(IFileDescriptor& fd, const char* label, const LatencyHistogram& hist) {
+        PrintToFD(fd, "%-8.8s %7lu %6lu %6lu %6lu %8lu\n",
+                  label, hist.Count(),
+                  hist.Percentile(50), hist.Percentile(90), hist.Percentile(99), hist.Max());
+    }
+
     /// 空白区切りのコマンドライン引数を配列（argbuf）に詰める
     WithError<int> MakeArgVector(char* command, char* first_arg, char** argv, int argv_len, char* argbuf, int argbuf_len) {
         int argc = 0;
@@ -83,6 +152,19 @@ namespace {
         return 0;
     }
 
+    /// PT_TLS セグメントからスレッドローカル領域の雛形を得る
+    /// 雛形の初期値はLOADセグメントに含まれているので、ロード後のアドレスをそのまま参照できる
+    TLSTemplate GetTLSTemplate(Elf64_Ehdr* ehdr) {
+        auto phdr = GetProgramHeader(ehdr);
+        for (int i = 0; i < ehdr->e_phnum; i++) {
+            if (phdr[i].p_type != PT_TLS) {
+                continue;
+            }
+            return {phdr[i].p_vaddr, phdr[i].p_filesz, phdr[i].p_memsz, phdr[i].p_align};
+        }
+        return {};
+    }
+
     static_assert(kBytesPerFrame >= 4096);
 
     /// LOADセグメントを最終目的地にコピー
@@ -220,7 +302,7 @@ namespace {
             return {{}, err_load};
         }
 
-        AppLoadInfo app_load{last_addr, elf_header->e_entry, temp_pml4};
+        AppLoadInfo app_load{last_addr, elf_header->e_entry, temp_pml4, GetTLSTemplate(elf_header)};
         g_app_loads->insert(std::make_pair(&file_entry, app_load));
 
         if (auto [pml4, err] = SetupPML4(task); err) {
@@ -416,27 +498,50 @@ void Terminal::ExecuteLine() {
     }
 
     std::shared_ptr<PipeDescriptor> pipe_fd;
-    uint64_t subtask_id = 0;
+    std::vector<uint64_t> stage_task_ids;
 
     // パイプ処理
+    // 2段目以降のコマンドを実行するタスクをすべて先に作り、隣り合う段をパイプでつないで並行に動かす
     if (pipe_char) {
-        *pipe_char = 0;
-        char* subcommand = &pipe_char[1]; // パイプ右側のコマンド（受信側）
-        while (isspace(*subcommand)) {
-            subcommand++;
+        // "|" で区切って2段目以降のコマンドラインを取り出す（1段目はこのターミナルで実行する）
+        std::vector<char*> subcommands;
+        for (char* p = pipe_char; p; p = strchr(p, '|')) {
+            *p = 0;
+            do {
+                p++;
+            } while (isspace(*p));
+            subcommands.push_back(p);
         }
 
-        auto& subtask = g_task_manager->NewTask();
-        pipe_fd = std::make_shared<PipeDescriptor>(subtask);
-        // 送信先タスクの標準入出力を付け替える
-        auto term_desc = new TerminalDescriptor{subcommand, true, false, {pipe_fd, files_[1], files_[2]}};
-        // 現在のターミナル（送信元）の標準出力をパイプに接続
+        // 最後の段の出力先（リダイレクト先か元の標準出力）
+        auto last_stdout = files_[1];
+        auto in_pipe = std::make_shared<Pipe>();
+        // 現在のターミナル（1段目）の標準出力をパイプに接続
+        pipe_fd = std::make_shared<PipeDescriptor>(in_pipe);
         files_[1] = pipe_fd;
-        subtask_id = subtask.InitContext(TaskTerminal, reinterpret_cast<int64_t>(term_desc))
-                         .Wakeup()
-                         .ID();
-        // パイプ処理の間は、各種イベントを送信先タスクに通知
-        (*g_layer_task_map)[layer_id_] = subtask_id;
+
+        for (size_t i = 0; i < subcommands.size(); i++) {
+            std::shared_ptr<Pipe> out_pipe;
+            std::shared_ptr<IFileDescriptor> out_fd = last_stdout;
+            if (i + 1 < subcommands.size()) {
+                out_pipe = std::make_shared<Pipe>();
+                out_fd = std::make_shared<PipeDescriptor>(out_pipe);
+            }
+            // 各段のタスクの標準入出力を付け替える
+            auto term_desc = new TerminalDescriptor{
+                subcommands[i], true, false,
+                {std::make_shared<PipeDescriptor>(in_pipe), out_fd, files_[2]},
+                in_pipe, out_pipe};
+            auto& subtask = g_task_manager->NewTask();
+            stage_task_ids.push_back(subtask.InitContext(TaskTerminal, reinterpret_cast<int64_t>(term_desc))
+                                         .Wakeup()
+                                         .ID());
+            in_pipe = out_pipe;
+        }
+        // パイプ処理の間は、各種イベントを2段目のタスクに通知
+        __asm__("cli");
+        (*g_layer_task_map)[layer_id_] = stage_task_ids[0];
+        __asm__("sti");
     }
 
     if (strcmp(command, "echo") == 0) {
@@ -449,10 +554,7 @@ void Terminal::ExecuteLine() {
         }
         PrintToFD(*files_[1], "\n");
     } else if (strcmp(command, "clear") == 0) {
-        if (show_window_) {
-            FillRectangle(*window_->InnerWriter(), {4, 4}, {8 * kColumns, 16 * kRows}, {0, 0, 0});
-        }
-        cursor_.y = 0;
+        ClearScreen();
     } else if (strcmp(command, "lspci") == 0) {
         for (int i = 0; i < pci::g_num_device; i++) {
             const auto& device = pci::g_devices[i];
@@ -503,16 +605,9 @@ void Terminal::ExecuteLine() {
             }
         }
         if (fd) { // ファイルが見つかった
-            char u8buf[1024];
             DrawCursor(false);
-
-            while (true) {
-                if (ReadDelim(*fd, '\n', u8buf, sizeof(u8buf)) == 0) { // 1行ずつ読む
-                    break;
-                }
-                PrintToFD(*files_[1], "%s", u8buf);
-            }
-
+            // リダイレクト先がファイルなら、クラスタからクラスタへ直接コピーされる
+            Splice(*files_[1], *fd, std::numeric_limits<size_t>::max());
             DrawCursor(true);
         }
     } else if (strcmp(command, "noterm") == 0) { // ex. noterm <command line>
@@ -530,6 +625,73 @@ void Terminal::ExecuteLine() {
         PrintToFD(*files_[1], "Phys total : %lu frames (%llu MiB)\n",
                   p_stat.total_frames,
                   p_stat.total_frames * kBytesPerFrame / 1024 / 1024);
+    } else if (strcmp(command, "ps") == 0) { // タスクごとの統計情報を表示
+        __asm__("cli");
+        const auto snapshots = g_task_manager->Snapshot();
+        __asm__("sti");
+        PrintTaskSnapshots(*files_[1], snapshots, {}, true);
+    } else if (strcmp(command, "top") == 0) { // タスクごとの統計情報を1秒ごとに更新して表示
+        ShowTop();
+    } else if (strcmp(command, "lat") == 0) { // 起床してから実行されるまでの待ち時間（µs）
+        if (first_arg && strcmp(first_arg, "reset") == 0) {
+            __asm__("cli");
+            g_task_manager->ResetLatency();
+            __asm__("sti");
+        } else if (first_arg && first_arg[0]) { // lat <task id> : 指定タスクの分布を表示
+            const uint64_t task_id = strtoul(first_arg, nullptr, 0);
+            __asm__("cli");
+            Task* task = g_task_manager->FindTask(task_id);
+            const auto hist = task ? task->WakeupLatency() : LatencyHistogram{};
+            __asm__("sti");
+            if (!task) {
+                PrintToFD(*files_[2], "no such task: %s\n", first_arg);
+                exit_code = 1;
+            } else {
+                for (int i = 0; i < LatencyHistogram::kNumBuckets; i++) {
+                    if (hist.Buckets()[i] > 0) {
+                        PrintToFD(*files_[1], "< %8lu us : %lu\n",
+                                  LatencyHistogram::BucketUpperBound(i), hist.Buckets()[i]);
+                    }
+                }
+            }
+        } else { // 優先度別とタスク別の要約を表示
+            __asm__("cli");
+            std::array<LatencyHistogram, TaskManager::kMaxLevel + 1> levels;
+            for (int lv = 0; lv <= TaskManager::kMaxLevel; lv++) {
+                levels[lv] = g_task_manager->LevelLatency(lv);
+            }
+            const auto snapshots = g_task_manager->Snapshot();
+            __asm__("sti");
+
+            PrintToFD(*files_[1], "%-8s %7s %6s %6s %6s %8s\n", "", "COUNT", "P50", "P90", "P99", "MAX(us)");
+            for (int lv = TaskManager::kMaxLevel; lv >= 0; lv--) {
+                char label[16];
+                sprintf(label, "level %d", lv);
+                PrintLatencySummary(*files_[1], label, levels[lv]);
+            }
+            for (const auto& s : snapshots) {
+                if (s.wakeup_latency.Count() > 0) {
+                    char label[32];
+                    sprintf(label, "%lu:%s", s.id, s.name.data());
+                    PrintLatencySummary(*files_[1], label, s.wakeup_latency);
+                }
+            }
+        }
+    } else if (strcmp(command, "fps") == 0) { // 画面合成の統計情報。fps <数値> で合成の頻度を変更
+        if (first_arg && strcmp(first_arg, "reset") == 0) {
+            __asm__("cli");
+            ResetCompositorStats();
+            __asm__("sti");
+        } else if (first_arg && first_arg[0]) {
+            SetRefreshRate(atoi(first_arg));
+        }
+        __asm__("cli");
+        const auto stats = GetCompositorStats();
+        __asm__("sti");
+        PrintToFD(*files_[1], "refresh rate : %d Hz\n", RefreshRate());
+        PrintToFD(*files_[1], "frames : %lu (dropped %lu)\n", stats.frames, stats.dropped_frames);
+        PrintToFD(*files_[1], "%-8s %7s %6s %6s %6s %8s\n", "", "COUNT", "P50", "P90", "P99", "MAX(us)");
+        PrintLatencySummary(*files_[1], "compose", stats.frame_time);
     } else if (command[0] != 0) {
         auto file_entry = FindCommand(command);
         if (!file_entry) { // エントリが見つからない
@@ -547,17 +709,21 @@ void Terminal::ExecuteLine() {
     }
 
     if (pipe_fd) {
-        pipe_fd->FinishWrite(); // データ送信の終了を受信側に伝える
-        __asm__("cli");
-        // 送信元タスクが送信先タスクの終了を待機
-        auto [ec, err] = g_task_manager->WaitFinish(subtask_id);
+        pipe_fd->FinishWrite(); // データ送信の終了を2段目に伝える
+        // すべての段の終了を待機。終了コードは最後の段のものになる
+        for (uint64_t stage_task_id : stage_task_ids) {
+            __asm__("cli");
+            auto [ec, err] = g_task_manager->WaitFinish(stage_task_id);
+            __asm__("sti");
+            if (err) {
+                Log(kWarn, "failed to wait finish: %s\n", err.Name());
+            }
+            exit_code = ec;
+        }
         // イベント通知先の変更を解除
+        __asm__("cli");
         (*g_layer_task_map)[layer_id_] = task_.ID();
         __asm__("sti");
-        if (err) {
-            Log(kWarn, "failed to wait finish: %s\n", err.Name());
-        }
-        exit_code = ec;
     }
 
     last_exit_code_ = exit_code;
@@ -601,6 +767,17 @@ WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry, char* comm
         return {0, err};
     }
 
+    // 時刻情報ページを読み込み専用でマップ
+    LinearAddress4Level time_page_addr{TIME_PAGE_ADDR};
+    if (auto err = MapSharedPages(time_page_addr, reinterpret_cast<uint64_t>(g_time_page), 1, false)) {
+        return {0, err};
+    }
+
+    // スレッドと共有する資源はアプリごとに新しく用意する
+    task.SetSpace(std::make_shared<AppSpace>());
+    task.Space()->main_thread = task.ID();
+    task.Space()->tls = app_load.tls;
+
     // fd=0,1,2に標準入力、標準出力、標準エラー出力を設定
     for (int i = 0; i < 3; i++) {
         task.Files().push_back(files_[i]);
@@ -610,34 +787,139 @@ WithError<int> Terminal::ExecuteFile(fat::DirectoryEntry& file_entry, char* comm
     // アプリに関連する仮想アドレス範囲は以下のようになる
     // [0xffff 8000 0000 0000, elf_last_addr] : アプリのELF
     // [elf_next_page (dpaging_begin_), dpaging_end_) : アプリのデマンドページング範囲
-    // [dpaging_end_, 0xffff ffff ffff f000) : メモリマップドファイル範囲。メモリを拡大するときは前方に進める。
-    // [0xffff ffff ffff f000, 0xffff ffff ffff ffff] : スタック領域 + コマンドライン引数
+    // [dpaging_end_, 0xffff ffff fffe e000) : メモリマップドファイルとスレッドのスタック範囲。メモリを拡大するときは前方に進める。
+    // [0xffff ffff fffe e000, 0xffff ffff fffe f000) : 時刻情報ページ（読み込み専用）
+    // [0xffff ffff fffe f000, 0xffff ffff ffff ffff] : スタック領域 + コマンドライン引数
     const uint64_t elf_next_page = (app_load.vaddr_end + 4095) & 0xfffffffffffff000; // 4KiB単位のアドレスに切り上げ
     task.SetDPagingBegin(elf_next_page);
     task.SetDPagingEnd(elf_next_page);
 
-    task.SetFileMapEnd(stack_frame_addr.value);
+    task.SetFileMapEnd(time_page_addr.value);
+
+    // メインスレッドのスレッドローカル領域はスタック領域の末尾に置く
+    auto [thread_start, err_tls] = SetupThreadLocal(app_load.tls, stack_frame_addr.value + stack_size, task.ID());
+    if (err_tls) {
+        return {0, err_tls};
+    }
+    __asm__("cli");
+    task.Context().fs_base = thread_start.fs_base;
+    WriteMSR(kIA32_FS_BASE, thread_start.fs_base);
+    __asm__("sti");
+
+    // タスク一覧ではアプリ名で表示する
+    const char* app_name = strrchr(command, '/');
+    task.SetName(app_name ? app_name + 1 : command);
 
     // エントリポイントのアドレスを取得し、実行
     int ret = CallApp(argc.value,
                       argv,
                       3 << 3 | 3,
                       app_load.entry,
-                      stack_frame_addr.value + stack_size - 8,
+                      thread_start.rsp,
                       &task.OSStackPointer()); // アプリ終了時に復帰するスタックポインタ
 
+    // 他のスレッドの exit() による終了の要求は、このアプリで済んだ
+    __asm__("cli");
+    task.ClearExitRequest().SetInApp(false);
+    __asm__("sti");
+    // 残っているスレッドはアドレス空間を解放する前に終了させる
+    KillAppThreads(task);
+    __asm__("cli");
+    task.Context().fs_base = 0;
+    WriteMSR(kIA32_FS_BASE, 0);
+    __asm__("sti");
+
+    task.SetName("term");
     task.Files().clear();
     task.FileMaps().clear();
+    // アプリが登録したまま終了したタイマを取り消す
+    __asm__("cli");
+    g_timer_manager->CancelTimersIf([&task](const Timer& t) {
+        return t.TaskID() == task.ID() && t.Value() < 0;
+    });
+    __asm__("sti");
 
     // アプリ終了後、使用したメモリ領域を解放
     const uint64_t addr_first = 0xffff800000000000;
-    if (auto err = CleanPageMaps(LinearAddress4Level{addr_first})) {
-        return {ret, err};
+    const auto err_clean = CleanPageMaps(LinearAddress4Level{addr_first});
+    // マップしていたウィンドウやスレッドの記録も、次のアプリを待たずに手放す
+    __asm__("cli");
+    task.SetSpace(std::make_shared<AppSpace>());
+    __asm__("sti");
+    if (err_clean) {
+        return {ret, err_clean};
     }
 
     return {ret, FreePML4(task)};
 }
 
+void Terminal::ClearScreen() {
+    if (show_window_) {
+        FillRectangle(*window_->InnerWriter(), {4, 4}, {8 * kColumns, 16 * kRows}, {0, 0, 0});
+    }
+    cursor_.y = 0;
+}
+
+void Terminal::ShowTop() {
+    __asm__("cli");
+    auto snapshots = g_task_manager->Snapshot();
+    __asm__("sti");
+    if (!show_window_) { // 画面がなければ1回だけ表示
+        PrintTaskSnapshots(*files_[1], snapshots, {}, false);
+        return;
+    }
+
+    // 1秒ごとに更新する
+    const int kTopTimer = 2;
+    __asm__("cli");
+    const auto [timer, err] = g_timer_manager->AddTimer(
+        Timer{g_timer_manager->CurrentTick() + kTimerFreq, kTopTimer, task_.ID(), kTimerFreq});
+    __asm__("sti");
+    if (err) {
+        PrintToFD(*files_[2], "failed to add a timer: %s\n", err.Name());
+        return;
+    }
+
+    std::vector<TaskSnapshot> prev;
+    bool quit = false;
+    while (!quit) {
+        ClearScreen();
+        PrintTaskSnapshots(*files_[1], snapshots, prev, false);
+        PrintToFD(*files_[1], "press q to quit");
+        Redraw();
+
+        // 次の更新時刻になるか q が押されるまで待つ
+        while (true) {
+            __asm__("cli");
+            auto msg = task_.ReceiveMessage();
+            if (!msg) {
+                task_.Sleep();
+                __asm__("sti");
+                continue;
+            }
+            __asm__("sti");
+
+            if (msg->type == Message::kTimerTimeout && msg->arg.timer.value == kTopTimer) {
+                break;
+            }
+            if (msg->type == Message::kKeyPush && msg->arg.keyboard.press && msg->arg.keyboard.ascii == 'q') {
+                quit = true;
+                break;
+            }
+        }
+
+        prev = std::move(snapshots);
+        __asm__("cli");
+        snapshots = g_task_manager->Snapshot();
+        __asm__("sti");
+    }
+
+    __asm__("cli");
+    g_timer_manager->CancelTimer(timer);
+    __asm__("sti");
+    PrintToFD(*files_[1], "\n");
+}
+
 void Terminal::Print(char32_t c) {
     if (!show_window_) {
         return;
@@ -677,7 +959,7 @@ void Terminal::Print(const char* s, std::optional<size_t> len) {
     size_t i = 0;
     const size_t len_ = len ? *len : std::numeric_limits<size_t>::max();
 
-    while (s[i] && i < len_) {
+    while (i < len_ && s[i]) {
         const auto [u32, bytes] = ConvertUTF8to32(&s[i]);
         Print(u32);
         i += bytes;
@@ -693,7 +975,7 @@ void Terminal::Print(const char* s, std::optional<size_t> len) {
     // 画面を再描画
     Message msg = MakeLayerMessage(task_.ID(), LayerID(), LayerOperation::DrawArea, draw_area);
     __asm__("cli");
-    g_task_manager->SendMessage(kMainTaskID, msg);
+    g_task_manager->SendMessage(CompositorTaskID(), msg);
     __asm__("sti");
 }
 
@@ -701,7 +983,7 @@ void Terminal::Redraw() {
     Rectangle<int> draw_area{TopLevelWindow::kTopLeftMargin, window_->InnerSize()};
     Message msg = MakeLayerMessage(task_.ID(), LayerID(), LayerOperation::DrawArea, draw_area);
     __asm__("cli");
-    g_task_manager->SendMessage(kMainTaskID, msg);
+    g_task_manager->SendMessage(CompositorTaskID(), msg);
     __asm__("sti");
 }
 
@@ -741,6 +1023,7 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
     // グローバル変数を扱う際は割り込みを禁止しておくのが無難
     __asm__("cli");
     Task& task = g_task_manager->CurrentTask();
+    task.SetName("term");
     Terminal* terminal = new Terminal{task, term_desc};
     if (show_window) {
         g_layer_manager->Move(terminal->LayerID(), {100, 200});
@@ -758,16 +1041,25 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
     }
 
     if (term_desc && term_desc->exit_after_command) { // タスクを終了させる
+        if (term_desc->input_pipe) {
+            term_desc->input_pipe->CloseRead();
+        }
+        if (term_desc->output_pipe) { // 次の段に終端を伝える
+            term_desc->output_pipe->CloseWrite();
+        }
         delete term_desc;
         __asm__("cli");
         g_task_manager->Finish(terminal->LastExitCode());
         __asm__("sti");
     }
 
-    auto add_blink_timer = [task_id](unsigned long t) {
-        g_timer_manager->AddTimer(Timer{t + static_cast<int>(kTimerFreq * 0.5), 1, task_id});
-    };
-    add_blink_timer(g_timer_manager->CurrentTick());
+    // カーソル点滅用の周期タイマ
+    const int kBlinkTimer = 1;
+    const int kBlinkPeriod = static_cast<int>(kTimerFreq * 0.5);
+    __asm__("cli");
+    g_timer_manager->AddTimer(
+        Timer{g_timer_manager->CurrentTick() + kBlinkPeriod, kBlinkTimer, task_id, kBlinkPeriod});
+    __asm__("sti");
 
     bool window_isactive = false;
 
@@ -783,14 +1075,17 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
 
         switch (msg->type) {
         case Message::kTimerTimeout: {
-            add_blink_timer(msg->arg.timer.timeout);
+            // 終了したアプリのタイマなど、点滅用以外のタイマは無視
+            if (msg->arg.timer.value != kBlinkTimer) {
+                break;
+            }
             if (show_window && window_isactive) {
                 // 一定時間ごとにカーゾルを点滅させる
                 const auto area = terminal->BlinkCursor();
                 Message msg = MakeLayerMessage(task_id, terminal->LayerID(), LayerOperation::DrawArea, area);
-                // メインタスクに描画処理を要求
+                // 合成タスクに描画処理を要求
                 __asm__("cli");
-                g_task_manager->SendMessage(kMainTaskID, msg);
+                g_task_manager->SendMessage(CompositorTaskID(), msg);
                 __asm__("sti");
             }
         } break;
@@ -802,9 +1097,9 @@ void TaskTerminal(uint64_t task_id, int64_t data) {
                                                      msg->arg.keyboard.ascii);
                 if (show_window) {
                     Message msg = MakeLayerMessage(task_id, terminal->LayerID(), LayerOperation::DrawArea, area);
-                    // メインタスクに描画処理を要求
+                    // 合成タスクに描画処理を要求
                     __asm__("cli");
-                    g_task_manager->SendMessage(kMainTaskID, msg);
+                    g_task_manager->SendMessage(CompositorTaskID(), msg);
                     __asm__("sti");
                 }
             }
@@ -834,6 +1129,11 @@ size_t TerminalFileDescriptor::Read(void* buf, size_t len) {
         __asm__("cli");
         auto msg = term_.UnderlyingTask().ReceiveMessage();
         if (!msg) {
+            // 終了を要求されたスレッドは、入力を待たずにシステムコールから戻る
+            if (g_task_manager->CurrentTask().ExitRequested()) {
+                __asm__("sti");
+                return 0;
+            }
             term_.UnderlyingTask().Sleep();
             continue;
         }
@@ -866,7 +1166,37 @@ size_t TerminalFileDescriptor::Read(void* buf, size_t len) {
 }
 
 size_t TerminalFileDescriptor::Write(const void* buf, size_t len) {
-    term_.Print(reinterpret_cast<const char*>(buf), len);
+    const auto bufc = reinterpret_cast<const char*>(buf);
+    size_t begin = 0;
+
+    // 前回の末尾で途切れた文字の続きを補ってから表示する
+    if (pending_len_ > 0) {
+        const size_t need = CountUTF8Size(pending_[0]);
+        while (pending_len_ < need && begin < len) {
+            pending_[pending_len_++] = bufc[begin++];
+        }
+        if (pending_len_ < need) {
+            return len;
+        }
+        term_.Print(pending_.data(), pending_len_);
+        pending_len_ = 0;
+    }
+
+    // 末尾の文字の先頭バイトを探し、途切れていれば次の Write() に持ち越す
+    size_t end = len;
+    for (size_t back = 1; back < pending_.size() && back <= len - begin; back++) {
+        const uint8_t c = bufc[len - back];
+        if ((c & 0xc0) != 0x80) { // 継続バイト（10xxxxxx）以外
+            if (CountUTF8Size(c) > back) {
+                end = len - back;
+            }
+            break;
+        }
+    }
+    memcpy(pending_.data(), &bufc[end], len - end);
+    pending_len_ = len - end;
+
+    term_.Print(&bufc[begin], end - begin);
     term_.Redraw(); // 文字列を表示するたびにターミナル画面全体を再描画
     return len;
 }
@@ -875,67 +1205,14 @@ size_t TerminalFileDescriptor::Load(void* buf, size_t len, size_t offset) {
     return 0;
 }
 
-PipeDescriptor::PipeDescriptor(Task& task) : task_{task} {}
-
-size_t PipeDescriptor::Read(void* buf, size_t len) {
-    if (len_ > 0) {
-        const size_t copy_bytes = std::min(len_, len);
-        memcpy(buf, data_, copy_bytes);
-        len_ -= copy_bytes;
-        memmove(data_, &data_[copy_bytes], len_);
-        return copy_bytes;
-    }
-
-    if (closed_) {
-        return 0;
-    }
-
-    while (true) {
-        __asm__("cli");
-        auto msg = task_.ReceiveMessage();
-        if (!msg) {
-            task_.Sleep();
-            continue;
-        }
-        __asm__("sti");
-
-        if (msg->type != Message::kPipe) {
-            continue;
-        }
-
-        if (msg->arg.pipe.len == 0) { // 終了
-            closed_ = true;
-            return 0;
-        }
-
-        const size_t copy_bytes = std::min<size_t>(msg->arg.pipe.len, len);
-        memcpy(buf, msg->arg.pipe.data, copy_bytes);
-        len_ = msg->arg.pipe.len - copy_bytes;
-        memcpy(data_, &msg->arg.pipe.data[copy_bytes], len_);
-        return copy_bytes;
-    }
-}
-
-size_t PipeDescriptor::Write(const void* buf, size_t len) {
-    auto bufc = reinterpret_cast<const char*>(buf);
-    Message msg{Message::kPipe};
-    size_t sent_bytes = 0;
-    while (sent_bytes < len) {
-        msg.arg.pipe.len = std::min(len - sent_bytes, sizeof(msg.arg.pipe.data));
-        memcpy(msg.arg.pipe.data, &bufc[sent_bytes], msg.arg.pipe.len);
-        sent_bytes += msg.arg.pipe.len;
-        __asm__("cli");
-        // データ送信先に割り込み通知
-        task_.SendMessage(msg);
-        __asm__("sti");
+int TerminalFileDescriptor::Poll() {
+    auto msg = term_.UnderlyingTask().PeekMessage();
+    if (msg && msg->type == Message::kKeyPush && msg->arg.keyboard.press) {
+        return POLL_READABLE | POLL_WRITABLE;
     }
-    return len;
+    return POLL_WRITABLE;
 }
 
-void PipeDescriptor::FinishWrite() {
-    Message msg{Message::kPipe};
-    msg.arg.pipe.len = 0;
-    __asm__("cli");
-    task_.SendMessage(msg);
-    __asm__("sti");
+WaitQueue* TerminalFileDescriptor::PollWaitQueue() {
+    return &term_.UnderlyingTask().MessageWaiters();
 }
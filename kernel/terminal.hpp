@@ -11,6 +11,7 @@
 #include "fat.hpp"
 #include "layer.hpp"
 #include "paging.hpp"
+#include "pipe.hpp"
 #include "task.hpp"
 #include "window.hpp"
 
@@ -23,6 +24,8 @@ struct AppLoadInfo {
     uint64_t entry;
     /// アプリ固有の階層ページング構造
     PageMapEntry* pml4;
+    /// スレッドローカル領域の雛形（PT_TLS セグメントがなければ大きさ0）
+    TLSTemplate tls{};
 };
 
 struct TerminalDescriptor {
@@ -34,6 +37,10 @@ struct TerminalDescriptor {
     bool show_window;
     /// 標準入出力
     std::array<std::shared_ptr<IFileDescriptor>, 3> files;
+    /// 標準入力につながるパイプ。終了時に読み込み側を閉じ、書き込み側が待ち続けないようにする
+    std::shared_ptr<Pipe> input_pipe{};
+    /// 標準出力につながるパイプ。終了時に書き込み側を閉じる
+    std::shared_ptr<Pipe> output_pipe{};
 };
 
 /// ロード済みアプリの一覧
@@ -82,6 +89,10 @@ private:
     Vector2D<int> CalcCursorPos() const;
     /// 1行だけスクロール
     void Scroll1();
+    /// 画面を消去してカーソルを先頭行に戻す
+    void ClearScreen();
+    /// タスクの統計情報を q が押されるまで定期的に更新して表示する
+    void ShowTop();
     /// コマンド実行
     void ExecuteLine();
     /// 実行可能ファイル（カーネル本体に組み込まれていないアプリ）を読み込んで実行
@@ -101,33 +112,17 @@ public:
     /// キーボード入力から1文字だけ読み取る（標準入力）
     size_t Read(void* buf, size_t len) override;
     /// ターミナルに出力する（標準出力）
+    /// 末尾で途切れたUTF-8の文字は、続きが書き込まれるまで表示せずに持ち越す
     size_t Write(const void* buf, size_t len) override;
     size_t Size() const override { return 0; }
     size_t Load(void* buf, size_t len, size_t offset) override;
+    /// キーが押されたメッセージが届いていれば読み込める
+    int Poll() override;
+    WaitQueue* PollWaitQueue() override;
 
 private:
     Terminal& term_;
-};
-
-/// パイプそのもの
-class PipeDescriptor : public IFileDescriptor {
-public:
-    explicit PipeDescriptor(Task& task);
-    /// 送信先にメッセージキューからデータを受信させる
-    size_t Read(void* buf, size_t len) override;
-    /// 送信先にデータ送信
-    size_t Write(const void* buf, size_t len) override;
-    size_t Size() const override { return 0; }
-    size_t Load(void* buf, size_t len, size_t offset) override { return 0; }
-
-    /// パイプは普通のファイルと違って末尾がないため、データがこれ以上存在しないことを伝える別の方法がこれ
-    void FinishWrite();
-
-private:
-    /// データ送信先のタスク（パイプ右側のコマンド）
-    Task& task_;
-    char data_[16];
-    size_t len_{0};
-    /// 送信するデータがもうない -> true
-    bool closed_{false};
+    /// 前回の Write() の末尾で途切れたUTF-8の文字のバイト列
+    std::array<char, 4> pending_{};
+    size_t pending_len_{0};
 };
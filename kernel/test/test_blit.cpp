@@ -0,0 +1,134 @@
+#include <CppUTest/CommandLineTestRunner.h>
+
+#include <chrono>
+#include <cstdio>
+#include <vector>
+
+#include "blit.hpp"
+
+namespace {
+  /// 検証・計測する実装（CPU が対応しているものだけ）
+  std::vector<const BlitKernels*> AvailableKernels() {
+    std::vector<const BlitKernels*> kernels{&kScalarBlitKernels, &kSSE2BlitKernels};
+    if (CPUSupportsAVX2()) {
+      kernels.push_back(&kAVX2BlitKernels);
+    }
+    return kernels;
+  }
+
+  std::vector<uint32_t> Pattern(size_t n, uint32_t seed) {
+    std::vector<uint32_t> v(n);
+    for (size_t i = 0; i < n; i++) {
+      v[i] = (i * 2654435761u + seed) & 0xffffff;
+    }
+    return v;
+  }
+}
+
+TEST_GROUP(Blit) {
+};
+
+// 端数の処理と先頭がずれた行を確かめるため、長さと開始位置を変えて scalar 版と比べる
+TEST(Blit, MatchesScalar) {
+  for (auto kernels : AvailableKernels()) {
+    for (size_t offset = 0; offset < 4; offset++) {
+      for (size_t n = 0; n < 40; n++) {
+        auto src = Pattern(n + offset, 1);
+        // 4画素に1つを透過色にする
+        const uint32_t key = 0x00ff00;
+        for (size_t i = 0; i < src.size(); i += 4) {
+          src[i] = key;
+        }
+
+        auto expected = Pattern(n + offset, 7);
+        auto actual = expected;
+        kScalarBlitKernels.copy_keyed(&expected[offset], &src[offset], n, key);
+        kernels->copy_keyed(&actual[offset], &src[offset], n, key);
+        CHECK_TRUE(expected == actual);
+
+        kScalarBlitKernels.copy(&expected[offset], &src[offset], n);
+        kernels->copy(&actual[offset], &src[offset], n);
+        CHECK_TRUE(expected == actual);
+
+        // 乗算済みアルファの画素（アルファ値 0, 中間, 255 が混ざる）
+        auto argb = Pattern(n + offset, 5);
+        for (size_t i = 0; i < argb.size(); i++) {
+          const uint32_t a = (i % 3 == 0) ? 0 : (i % 3 == 1) ? 0x80 : 0xff;
+          const uint32_t r = ((argb[i] >> 16) & 0xff) * a / 255;
+          const uint32_t g = ((argb[i] >> 8) & 0xff) * a / 255;
+          const uint32_t b = (argb[i] & 0xff) * a / 255;
+          argb[i] = (a << 24) | (r << 16) | (g << 8) | b;
+        }
+        for (uint32_t opacity : {255u, 200u, 0u}) {
+          kScalarBlitKernels.blend(&expected[offset], &argb[offset], n, opacity, 0);
+          kernels->blend(&actual[offset], &argb[offset], n, opacity, 0);
+          CHECK_TRUE(expected == actual);
+          kScalarBlitKernels.blend(&expected[offset], &src[offset], n, opacity, 0xff000000);
+          kernels->blend(&actual[offset], &src[offset], n, opacity, 0xff000000);
+          CHECK_TRUE(expected == actual);
+        }
+
+        kScalarBlitKernels.fill(&expected[offset], 0x123456, n);
+        kernels->fill(&actual[offset], 0x123456, n);
+        CHECK_TRUE(expected == actual);
+      }
+    }
+  }
+}
+
+TEST(Blit, Blend) {
+  // 不透明度 255 の不透明な画素はそのまま、完全に透明な画素は下地のまま
+  const uint32_t src[3] = {0xff102030, 0x00000000, 0x80400000};
+  uint32_t dst[3] = {0xff000000, 0xff00ff00, 0xff0000ff};
+  GetBlitKernels().blend(dst, src, 3, 255, 0);
+  CHECK_EQUAL(0xff102030, dst[0]);
+  CHECK_EQUAL(0xff00ff00, dst[1]);
+  // 半透明の赤 (0x40 = 0x80 の乗算済み) を青に重ねる
+  CHECK_EQUAL(0xff40007f, dst[2]);
+
+  // 不透明なウィンドウを半分の不透明度で重ねる
+  const uint32_t opaque = 0x00ffffff;
+  uint32_t d = 0xff000000;
+  GetBlitKernels().blend(&d, &opaque, 1, 128, 0xff000000);
+  CHECK_EQUAL(0xff808080, d);
+}
+
+TEST(Blit, CopyKeyedSkipsKey) {
+  const uint32_t src[5] = {1, 0xff00ff, 2, 0xff00ff, 3};
+  uint32_t dst[5] = {9, 9, 9, 9, 9};
+  GetBlitKernels().copy_keyed(dst, src, 5, 0xff00ff);
+  const uint32_t expected[5] = {1, 9, 2, 9, 3};
+  MEMCMP_EQUAL(expected, dst, sizeof(dst));
+}
+
+// 各実装の処理速度を表示する（1920x1080 の画面を繰り返し処理する）
+TEST(Blit, Throughput) {
+  const size_t kWidth = 1920, kHeight = 1080, kRepeat = 20;
+  const auto src = Pattern(kWidth * kHeight, 3);
+  std::vector<uint32_t> dst(kWidth * kHeight);
+
+  auto measure = [&](auto&& f) {
+    const auto begin = std::chrono::steady_clock::now();
+    for (size_t r = 0; r < kRepeat; r++) {
+      for (size_t y = 0; y < kHeight; y++) {
+        f(&dst[y * kWidth], &src[y * kWidth]);
+      }
+    }
+    const std::chrono::duration<double> sec = std::chrono::steady_clock::now() - begin;
+    return sizeof(uint32_t) * kWidth * kHeight * kRepeat / sec.count() / (1 << 20);
+  };
+
+  for (auto kernels : AvailableKernels()) {
+    const double fill = measure([&](uint32_t* d, const uint32_t*) { kernels->fill(d, 0x2d76ed, kWidth); });
+    const double copy = measure([&](uint32_t* d, const uint32_t* s) { kernels->copy(d, s, kWidth); });
+    const double keyed = measure([&](uint32_t* d, const uint32_t* s) {
+      kernels->copy_keyed(d, s, kWidth, 0x000001);
+    });
+    const double blend = measure([&](uint32_t* d, const uint32_t* s) {
+      kernels->blend(d, s, kWidth, 192, 0xff000000);
+    });
+    printf("\n%-6s fill %8.0f MiB/s  copy %8.0f MiB/s  copy_keyed %8.0f MiB/s  blend %8.0f MiB/s",
+           kernels->name, fill, copy, keyed, blend);
+  }
+  printf("\n");
+}
@@ -0,0 +1,42 @@
+#include <CppUTest/CommandLineTestRunner.h>
+
+#include "latency_histogram.hpp"
+
+TEST_GROUP(LatencyHistogram) {
+  LatencyHistogram hist;
+};
+
+TEST(LatencyHistogram, Buckets) {
+  hist.Record(0);
+  hist.Record(1);
+  hist.Record(3);
+  hist.Record(4);
+  hist.Record(1000000000);
+
+  const auto& b = hist.Buckets();
+  CHECK_EQUAL(1, b[0]);  // < 1us
+  CHECK_EQUAL(1, b[1]);  // [1, 2)
+  CHECK_EQUAL(1, b[2]);  // [2, 4)
+  CHECK_EQUAL(1, b[3]);  // [4, 8)
+  CHECK_EQUAL(1, b[LatencyHistogram::kNumBuckets - 1]);
+  CHECK_EQUAL(5, hist.Count());
+  CHECK_EQUAL(1000000000, hist.Max());
+}
+
+TEST(LatencyHistogram, Percentile) {
+  CHECK_EQUAL(0, hist.Percentile(50));
+
+  for (int i = 0; i < 90; i++) {
+    hist.Record(5);  // [4, 8)
+  }
+  for (int i = 0; i < 10; i++) {
+    hist.Record(100);  // [64, 128)
+  }
+  CHECK_EQUAL(8, hist.Percentile(50));
+  CHECK_EQUAL(8, hist.Percentile(90));
+  CHECK_EQUAL(128, hist.Percentile(99));
+
+  hist.Reset();
+  CHECK_EQUAL(0, hist.Count());
+  CHECK_EQUAL(0, hist.Percentile(99));
+}
@@ -0,0 +1,50 @@
+#include <CppUTest/CommandLineTestRunner.h>
+
+#include "message_queue.hpp"
+
+TEST_GROUP(MPSCQueue) {
+  MPSCQueue<int, 4> queue;
+};
+
+TEST(MPSCQueue, PushPop) {
+  CHECK_TRUE(queue.Empty());
+  CHECK_FALSE(queue.Pop().has_value());
+
+  CHECK_TRUE(queue.Push(1));
+  CHECK_TRUE(queue.Push(2));
+  CHECK_EQUAL(2, queue.Size());
+  CHECK_FALSE(queue.Empty());
+
+  CHECK_EQUAL(1, *queue.Pop());
+  CHECK_EQUAL(2, *queue.Pop());
+  CHECK_TRUE(queue.Empty());
+}
+
+TEST(MPSCQueue, Overflow) {
+  for (int i = 0; i < 4; i++) {
+    CHECK_TRUE(queue.Push(i));
+  }
+  // 満杯のときは追加されず、回数が数えられる
+  CHECK_FALSE(queue.Push(4));
+  CHECK_FALSE(queue.Push(5));
+  CHECK_EQUAL(2, queue.Overflows());
+
+  CHECK_EQUAL(0, *queue.Pop());
+  CHECK_TRUE(queue.Push(6));
+  for (int expected : {1, 2, 3, 6}) {
+    CHECK_EQUAL(expected, *queue.Pop());
+  }
+  CHECK_FALSE(queue.Pop().has_value());
+}
+
+TEST(MPSCQueue, WrapAround) {
+  // 何周しても順序が保たれる
+  for (int i = 0; i < 100; i++) {
+    CHECK_TRUE(queue.Push(i));
+    CHECK_TRUE(queue.Push(i + 1000));
+    CHECK_EQUAL(i, *queue.Pop());
+    CHECK_EQUAL(i + 1000, *queue.Pop());
+  }
+  CHECK_TRUE(queue.Empty());
+  CHECK_EQUAL(0, queue.Overflows());
+}
@@ -0,0 +1,82 @@
+#include <CppUTest/CommandLineTestRunner.h>
+
+#include "region.hpp"
+
+TEST_GROUP(Region) {
+  Region region;
+};
+
+TEST(Region, AddDisjoint) {
+  region.Add({{0, 0}, {10, 10}});
+  region.Add({{20, 0}, {10, 10}});
+  CHECK_EQUAL(2, region.Rects().size());
+  CHECK_EQUAL(200, region.Area());
+}
+
+TEST(Region, AddOverlapping) {
+  region.Add({{0, 0}, {10, 10}});
+  region.Add({{5, 5}, {10, 10}});
+  // 重なった部分は1回だけ数える
+  CHECK_EQUAL(175, region.Area());
+  for (size_t i = 0; i < region.Rects().size(); i++) {
+    for (size_t j = i + 1; j < region.Rects().size(); j++) {
+      CHECK_TRUE(IsEmpty(region.Rects()[i] & region.Rects()[j]));
+    }
+  }
+
+  // 既に含まれている矩形を加えても変わらない
+  region.Add({{2, 2}, {3, 3}});
+  CHECK_EQUAL(175, region.Area());
+}
+
+TEST(Region, CoalesceAdjacent) {
+  // 同じ行を左右に並べると1つの矩形になる
+  region.Add({{0, 0}, {8, 16}});
+  region.Add({{8, 0}, {8, 16}});
+  region.Add({{16, 0}, {8, 16}});
+  CHECK_EQUAL(1, region.Rects().size());
+  CHECK_EQUAL(24, region.Rects()[0].size.x);
+
+  // 同じ列を上下に並べても1つの矩形になる
+  region.Add({{0, 16}, {24, 16}});
+  CHECK_EQUAL(1, region.Rects().size());
+  CHECK_EQUAL(32, region.Rects()[0].size.y);
+}
+
+TEST(Region, Subtract) {
+  region.Add({{0, 0}, {30, 30}});
+  region.Subtract({{10, 10}, {10, 10}});
+  CHECK_EQUAL(800, region.Area());
+
+  region.Subtract({{0, 0}, {30, 30}});
+  CHECK_TRUE(region.Empty());
+}
+
+TEST(Region, Intersection) {
+  region.Add({{0, 0}, {30, 30}});
+  region.Subtract({{10, 10}, {10, 10}});
+  const auto inter = region.Intersection({{5, 5}, {10, 10}});
+  CHECK_EQUAL(75, inter.Area());
+  CHECK_EQUAL(800, region.Area());
+
+  CHECK_TRUE(region.Intersection({{40, 40}, {5, 5}}).Empty());
+}
+
+TEST(Region, Bounds) {
+  region.Add({{5, 5}, {5, 5}});
+  region.Add({{20, 30}, {10, 10}});
+  const auto bounds = region.Bounds();
+  CHECK_EQUAL(5, bounds.pos.x);
+  CHECK_EQUAL(5, bounds.pos.y);
+  CHECK_EQUAL(25, bounds.size.x);
+  CHECK_EQUAL(35, bounds.size.y);
+}
+
+TEST(Region, TooManyRects) {
+  // 斜めに並べるとまとめられないので、上限を超えると全体を囲む矩形になる
+  for (int i = 0; i <= static_cast<int>(Region::kMaxRects); i++) {
+    region.Add({{i * 2, i * 2}, {1, 1}});
+  }
+  CHECK_EQUAL(1, region.Rects().size());
+  CHECK_EQUAL(65, region.Rects()[0].size.x);
+}
@@ -0,0 +1,93 @@
+#include <CppUTest/CommandLineTestRunner.h>
+
+#include <vector>
+
+#include "timer.hpp"
+
+TEST_GROUP(TimerWheel) {
+  TimerWheel wheel;
+  std::vector<Timer> fired;
+
+  void Advance(unsigned long now) {
+    wheel.Advance(now, [this](const Timer& t) { fired.push_back(t); });
+  }
+};
+
+TEST(TimerWheel, ExpireInOrder) {
+  wheel.Add(Timer{10, 1, 0});
+  wheel.Add(Timer{5, 2, 0});
+  CHECK_EQUAL(5, wheel.NextEvent());
+
+  Advance(9);
+  CHECK_EQUAL(1, fired.size());
+  CHECK_EQUAL(2, fired[0].Value());
+
+  Advance(10);
+  CHECK_EQUAL(2, fired.size());
+  CHECK_EQUAL(1, fired[1].Value());
+  CHECK_EQUAL(0, wheel.Count());
+  CHECK_EQUAL(kNoTimeout, wheel.NextEvent());
+}
+
+TEST(TimerWheel, Cascade) {
+  // 最下層に収まらないタイマは上位の階層から移し替えられる
+  const unsigned long timeouts[] = {64, 100, 4096, 300000, 20000000};
+  for (int i = 0; i < 5; i++) {
+    wheel.Add(Timer{timeouts[i], i, 0});
+  }
+
+  Advance(20000000);
+  CHECK_EQUAL(5, fired.size());
+  for (int i = 0; i < 5; i++) {
+    CHECK_EQUAL(timeouts[i], fired[i].Timeout());
+  }
+}
+
+TEST(TimerWheel, Cancel) {
+  const auto h1 = wheel.Add(Timer{10, 1, 0});
+  const auto h2 = wheel.Add(Timer{10, 2, 0});
+
+  CHECK_TRUE(wheel.Cancel(h1.value));
+  CHECK_FALSE(wheel.Cancel(h1.value));
+
+  Advance(10);
+  CHECK_EQUAL(1, fired.size());
+  CHECK_EQUAL(2, fired[0].Value());
+  // タイムアウト済みのハンドルは無効
+  CHECK_FALSE(wheel.Cancel(h2.value));
+}
+
+TEST(TimerWheel, CancelIf) {
+  wheel.Add(Timer{10, 1, 3});
+  wheel.Add(Timer{20, 2, 4});
+  wheel.Add(Timer{30, 3, 3});
+
+  CHECK_EQUAL(2, wheel.CancelIf([](const Timer& t) { return t.TaskID() == 3; }));
+  Advance(100);
+  CHECK_EQUAL(1, fired.size());
+  CHECK_EQUAL(2, fired[0].Value());
+}
+
+TEST(TimerWheel, Periodic) {
+  wheel.Add(Timer{10, 1, 0, 10});
+
+  Advance(10);
+  Advance(20);
+  Advance(35);
+  CHECK_EQUAL(3, fired.size());
+  CHECK_EQUAL(30, fired[2].Timeout());
+
+  // 処理が遅れた分の周期は飛ばし、周期はずらさない
+  Advance(1005);
+  CHECK_EQUAL(4, fired.size());
+  CHECK_EQUAL(40, fired[3].Timeout());
+  CHECK_EQUAL(1010, wheel.NextEvent());
+  CHECK_EQUAL(1, wheel.Count());
+}
+
+TEST(TimerWheel, Full) {
+  for (size_t i = 0; i < TimerWheel::kMaxTimers; i++) {
+    CHECK_FALSE(wheel.Add(Timer{100, 1, 0}).error);
+  }
+  CHECK_EQUAL(Error::kFull, wheel.Add(Timer{100, 1, 0}).error.Cause());
+}
@@ -0,0 +1,218 @@
+#include "thread.hpp"
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+
+#include "asmfunc.h"
+#include "paging.hpp"
+
+namespace {
+    /// スタック領域の下に置く、ページを割り当てないガードページの大きさ
+    const uint64_t kGuardBytes = 4096;
+    /// TCB の大きさ（自分自身のアドレスとスレッドID）
+    const uint64_t kTCBBytes = 16;
+
+    /// スレッドのタスクに渡す開始情報
+    struct AppThreadStart {
+        uint64_t entry, arg;
+        uint64_t stack_end;
+        ThreadStartInfo info;
+    };
+
+    /// アプリのスレッドを実行するタスク
+    /// アプリから戻ったらスタック領域を返却して終了する
+    void TaskAppThread(uint64_t task_id, int64_t data) {
+        const auto start = reinterpret_cast<AppThreadStart*>(data);
+        const AppThreadStart s = *start;
+        delete start;
+
+        __asm__("cli");
+        Task& task = g_task_manager->CurrentTask();
+        // 実行を始める前に終了を要求されていたら、アプリを実行せずに終了する
+        int ret = task.RequestedExitCode();
+        const bool run = !task.ExitRequested();
+        task.SetInApp(run);
+        __asm__("sti");
+
+        if (run) {
+            ret = CallApp(0,
+                          reinterpret_cast<char**>(s.arg),
+                          3 << 3 | 3,
+                          s.entry,
+                          s.info.rsp,
+                          &task.OSStackPointer());
+        }
+
+        __asm__("cli");
+        // 例外で強制終了された場合は、アプリを実行中のまま戻ってくる
+        task.SetInApp(false);
+        task.Space()->free_stacks.push_back(s.stack_end);
+        g_task_manager->Finish(ret);
+    }
+
+    /// スレッド用のスタック領域を確保する
+    /// 終了したスレッドの領域があれば再利用し、なければメモリマップドファイル範囲の前方から切り出す
+    /// return : スタック領域の末尾アドレス
+    WithError<uint64_t> AllocateThreadStack(Task& task) {
+        AppSpace& space = *task.Space();
+        __asm__("cli");
+        if (!space.free_stacks.empty()) {
+            const uint64_t stack_end = space.free_stacks.back();
+            space.free_stacks.pop_back();
+            __asm__("sti");
+            return {stack_end, MAKE_ERROR(Error::kSuccess)};
+        }
+
+        const uint64_t stack_end = space.file_map_end;
+        const uint64_t guard_begin = stack_end - kAppThreadStackBytes - kGuardBytes;
+        if (guard_begin < space.dpaging_end) {
+            __asm__("sti");
+            return {0, MAKE_ERROR(Error::kNoEnoughMemory)};
+        }
+        space.file_map_end = guard_begin;
+        __asm__("sti");
+
+        LinearAddress4Level stack_addr{guard_begin + kGuardBytes};
+        if (auto err = SetupPageMaps(stack_addr, kAppThreadStackBytes / 4096)) {
+            return {0, err};
+        }
+        return {stack_end, MAKE_ERROR(Error::kSuccess)};
+    }
+} // namespace
+
+WithError<ThreadStartInfo> SetupThreadLocal(const TLSTemplate& tls, uint64_t stack_end, uint64_t tid) {
+    const uint64_t align = std::max<uint64_t>(tls.align, 16);
+    if ((align & (align - 1)) != 0) {
+        return {{}, MAKE_ERROR(Error::kInvalidFormat)};
+    }
+
+    // TCB をスタック末尾に置き、その直前にスレッドローカル領域を置く
+    const uint64_t tcb = (stack_end - kTCBBytes) & ~(align - 1);
+    const uint64_t tls_bytes = (tls.memsz + align - 1) & ~(align - 1);
+    const uint64_t tls_begin = tcb - tls_bytes;
+    // スレッドローカル領域が大きすぎてスタックが残らない
+    if (tls_begin < stack_end - kAppThreadStackBytes + 4096) {
+        return {{}, MAKE_ERROR(Error::kNoEnoughMemory)};
+    }
+
+    auto block = reinterpret_cast<uint8_t*>(tls_begin);
+    memcpy(block, reinterpret_cast<const void*>(tls.vaddr), tls.filesz);
+    memset(block + tls.filesz, 0, tls_bytes - tls.filesz);
+
+    auto tcb_ptr = reinterpret_cast<uint64_t*>(tcb);
+    tcb_ptr[0] = tcb;
+    tcb_ptr[1] = tid;
+
+    // スタックのアライメント制約を満たすため、16byte境界から8byteずれた位置に調整
+    return {{tcb, (tls_begin & ~0xflu) - 8}, MAKE_ERROR(Error::kSuccess)};
+}
+
+WithError<uint64_t> CreateAppThread(uint64_t entry, uint64_t arg) {
+    __asm__("cli");
+    Task& current = g_task_manager->CurrentTask();
+    __asm__("sti");
+
+    auto [stack_end, err] = AllocateThreadStack(current);
+    if (err) {
+        return {0, err};
+    }
+
+    __asm__("cli");
+    Task& thread = g_task_manager->NewTask();
+    __asm__("sti");
+
+    auto [info, err_tls] = SetupThreadLocal(current.Space()->tls, stack_end, thread.ID());
+    if (err_tls) {
+        // 一度も実行していないタスクを片付ける
+        __asm__("cli");
+        current.Space()->free_stacks.push_back(stack_end);
+        g_task_manager->Kill(thread.ID(), 0);
+        g_task_manager->WaitFinish(thread.ID());
+        __asm__("sti");
+        return {0, err_tls};
+    }
+
+    auto start = new AppThreadStart{entry, arg, stack_end, info};
+    // InitContext() は現在のCR3（アプリの階層ページング構造）を引き継ぐ
+    thread.InitContext(TaskAppThread, reinterpret_cast<int64_t>(start))
+        .SetSpace(current.Space())
+        .SetName(current.Name());
+    thread.Context().fs_base = info.fs_base;
+
+    __asm__("cli");
+    current.Space()->threads.push_back(thread.ID());
+    g_task_manager->Wakeup(&thread, current.Level());
+    __asm__("sti");
+    return {thread.ID(), MAKE_ERROR(Error::kSuccess)};
+}
+
+WithError<int> JoinAppThread(uint64_t tid) {
+    __asm__("cli");
+    Task& current = g_task_manager->CurrentTask();
+    auto& threads = current.Space()->threads;
+    if (tid == current.ID() || std::find(threads.begin(), threads.end(), tid) == threads.end()) {
+        __asm__("sti");
+        return {0, MAKE_ERROR(Error::kNoSuchTask)};
+    }
+
+    auto [exit_code, err] = g_task_manager->WaitFinish(tid);
+    if (!err) {
+        threads.erase(std::remove(threads.begin(), threads.end(), tid), threads.end());
+    }
+    __asm__("sti");
+    return {exit_code, err};
+}
+
+void JoinAllAppThreads(Task& main_task) {
+    auto& threads = main_task.Space()->threads;
+    __asm__("cli");
+    while (!threads.empty()) {
+        // 他のスレッドが合流を待っているスレッドは、そちらに任せる
+        // 待っている間に他のスレッドが合流して、リストが変わることがある
+        bool joined = false;
+        for (size_t i = threads.size(); i > 0; i--) {
+            const uint64_t tid = threads[i - 1];
+            auto [exit_code, err] = g_task_manager->WaitFinish(tid);
+            if (err.Cause() == Error::kBusy) {
+                continue;
+            }
+            threads.erase(std::remove(threads.begin(), threads.end(), tid), threads.end());
+            joined = true;
+            break;
+        }
+        // 残ったスレッドが互いに合流を待っていて終わらないなら、KillAppThreads() に任せる
+        if (!joined) {
+            break;
+        }
+    }
+    __asm__("sti");
+}
+
+void KillAppThreads(Task& main_task) {
+    auto& space = *main_task.Space();
+    __asm__("cli");
+    const auto threads = space.threads;
+    for (uint64_t tid : threads) {
+        Task* thread = g_task_manager->FindTask(tid);
+        if (thread == nullptr) { // 既に終了していれば、終了コードを回収するだけ
+            continue;
+        }
+        if (thread->InApp()) {
+            // アプリのコードの途中なら、カーネルの資源を使っていないのでその場で終了させられる
+            g_task_manager->Kill(tid, 128 + SIGKILL);
+            continue;
+        }
+        // システムコールの途中で終了させると、カーネルの資源が中途半端な状態で残ってしまう
+        // 終了を要求して起こし、待機を中断してアプリに戻る時点で自ら終了させる
+        thread->RequestExit(128 + SIGKILL);
+        g_task_manager->CancelWaitFinish(thread);
+        g_task_manager->Wakeup(thread);
+    }
+    for (uint64_t tid : threads) {
+        g_task_manager->WaitFinish(tid);
+    }
+    space.threads.clear();
+    space.free_stacks.clear();
+    __asm__("sti");
+}
@@ -0,0 +1,37 @@
+/// アプリのスレッド
+/// 同じアプリのスレッドは階層ページング構造とファイルディスクリプタ（AppSpace）を共有するタスクとして実装する
+
+#pragma once
+
+#include <cstdint>
+
+#include "error.hpp"
+#include "task.hpp"
+
+/// スレッドごとのスタック領域の大きさ（64KiB）
+const uint64_t kAppThreadStackBytes = 16 * 4096;
+
+/// スレッドの開始時のレジスタの値
+struct ThreadStartInfo {
+    /// FSセグメントのベースアドレス（TCBの位置）
+    uint64_t fs_base;
+    /// スタックポインタの初期値
+    uint64_t rsp;
+};
+
+/// スタック領域の末尾にスレッドローカル領域とTCBを構築する（x86-64 の variant II 形式）
+/// TCB の先頭には自分自身のアドレスとスレッドIDを格納する
+/// 呼び出し時にアプリの階層ページング構造が有効になっていること
+WithError<ThreadStartInfo> SetupThreadLocal(const TLSTemplate& tls, uint64_t stack_end, uint64_t tid);
+
+/// 実行中のアプリに新しいスレッドを作り、entry(0, arg) から実行を始める
+/// return : スレッドのタスクID
+WithError<uint64_t> CreateAppThread(uint64_t entry, uint64_t arg);
+/// 同じアプリのスレッドの終了を待ち、終了コードを得る
+/// 1つのスレッドに合流できるのは1つのスレッドだけ。他のスレッドが既に待っていれば kBusy を返す
+WithError<int> JoinAppThread(uint64_t tid);
+/// メインスレッド以外のスレッドがすべて終了するのを待つ
+void JoinAllAppThreads(Task& main_task);
+/// メインスレッド以外のスレッドを強制的に終了させる
+/// システムコールの途中のスレッドには終了を要求し、アプリに戻る時点で終了するのを待つ
+void KillAppThreads(Task& main_task);
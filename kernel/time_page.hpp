@@ -0,0 +1,50 @@
+/// 時刻情報ページ
+/// カーネルが全アプリのアドレス空間に読み込み専用でマップするページ
+/// アプリはシステムコールを使わずに、このページとTSCから現在時刻を算出できる
+
+#pragma once
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// アプリのアドレス空間における時刻情報ページの位置（スタック領域の直下）
+#define TIME_PAGE_ADDR 0xfffffffffffee000ull
+
+struct TimePage {
+    /// シーケンスカウンタ（seqlock）
+    /// カーネルは更新の前後で1ずつ増やすので、奇数なら更新中
+    /// 読み出しの前後で値が変わっていたら読み直す
+    volatile uint32_t seq;
+    uint32_t reserved;
+    /// 起動時刻（経過時間0）に対応するTSCの値
+    volatile uint64_t tsc_base;
+    /// TSCの周波数（1秒あたりのカウント数）
+    volatile uint64_t tsc_freq;
+    /// 最後にタイマ割り込みを処理した時点のティック数
+    volatile uint64_t tick;
+    /// 1秒あたりのティック数
+    volatile uint64_t tick_freq;
+};
+
+/// 起動からの経過時間（ナノ秒）を時刻情報ページから算出する
+static inline uint64_t TimePageNanoseconds(const struct TimePage* page) {
+    uint32_t seq;
+    uint64_t tsc_base, tsc_freq;
+    do {
+        seq = page->seq;
+        __asm__ volatile("" ::: "memory");
+        tsc_base = page->tsc_base;
+        tsc_freq = page->tsc_freq;
+        __asm__ volatile("" ::: "memory");
+    } while ((seq & 1) || seq != page->seq);
+
+    const uint64_t count = __builtin_ia32_rdtsc() - tsc_base;
+    return count / tsc_freq * 1000000000 + count % tsc_freq * 1000000000 / tsc_freq;
+}
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
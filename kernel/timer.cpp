@@ -1,7 +1,13 @@
 #include "timer.hpp"
 
+#include <algorithm>
+
 #include "acpi.hpp"
+#include "asmfunc.h"
 #include "interrupt.hpp"
+#include "logger.hpp"
+#include "memory_manager.hpp"
+#include "msr.hpp"
 #include "task.hpp"
 
 namespace {
@@ -15,6 +21,40 @@ namespace {
     volatile uint32_t& g_current_count = *reinterpret_cast<uint32_t*>(0xfee00390);
     /// 分周比の設定（クロックをn分の1にする）。分周比を大きくするほどカウンタの減り方がゆっくりになる
     volatile uint32_t& g_divide_config = *reinterpret_cast<uint32_t*>(0xfee003e0);
+
+    /// LVT Timerのタイマモード（bit 17-18）
+    const uint32_t kLVTOneShot = 0b00 << 17;
+    const uint32_t kLVTTSCDeadline = 0b10 << 17;
+    /// LVT Timerの割り込みマスク（bit 16）
+    const uint32_t kLVTMasked = 1 << 16;
+
+    /// TSCデッドラインモードが使える : true
+    bool g_use_tsc_deadline = false;
+    /// ティック数0に対応するTSCの値
+    uint64_t g_tsc_base;
+    /// 1ティック当たりのTSCカウント数
+    uint64_t g_tsc_per_tick;
+    /// 1ティック当たりのLocal APICタイマのカウント数
+    uint64_t g_lapic_per_tick;
+
+    bool SupportsTSCDeadline() {
+        uint32_t regs[4];
+        CPUID(1, 0, regs);
+        // CPUID.01H:ECX[24]
+        return (regs[2] >> 24) & 1;
+    }
+
+    /// CPUの動作周波数やスリープ状態によらず、TSCが一定の速さで増加する : true
+    bool SupportsInvariantTSC() {
+        uint32_t regs[4];
+        CPUID(0x80000000, 0, regs);
+        if (regs[0] < 0x80000007) {
+            return false;
+        }
+        CPUID(0x80000007, 0, regs);
+        // CPUID.80000007H:EDX[8]
+        return (regs[3] >> 8) & 1;
+    }
 } // namespace
 
 void InitializeLAPICTimer() {
@@ -22,23 +62,52 @@ void InitializeLAPICTimer() {
 
     g_divide_config = 0b1011; // divide 1:1
     // 割り込み不許可
-    g_lvt_timer = (0b010 << 16);
+    g_lvt_timer = kLVTMasked | kLVTOneShot;
 
+    // Local APICタイマとTSCを同時に計測する
+    const auto tsc_start = ReadTSC();
     StartLAPICTimer();
     // 100msec(0.1sec)待機
     acpi::WaitMillisecondes(100);
     const auto elapsed = LAPICTimerElapsed();
+    const auto tsc_elapsed = ReadTSC() - tsc_start;
     StopLAPICTimer();
 
     // 1000msec(1sec)当たりのカウント数
     g_lapic_timer_freq = static_cast<unsigned long>(elapsed) * 10;
+    g_tsc_freq = tsc_elapsed * 10;
+    g_lapic_per_tick = g_lapic_timer_freq / kTimerFreq;
+    g_tsc_per_tick = g_tsc_freq / kTimerFreq;
+    if (!SupportsInvariantTSC()) {
+        Log(kInfo, "TSC is not invariant. clock may drift.\n");
+    }
+    Log(kDebug, "TSC frequency: %lu Hz\n", g_tsc_freq);
 
-    g_divide_config = 0b1011; // divide 1:1
     // 割り込み許可
-    // Current Counter レジスタの値が0になるたびに割り込み発生
-    g_lvt_timer = (0b010 << 16) | InterruptVector::kLAPICTimer;
-    // 約10msecごとに割り込みが発生するはず
-    g_initial_count = g_lapic_timer_freq / kTimerFreq;
+    // 周期的には割り込まず、TimerManager::Reprogram()で設定した時刻に1回だけ割り込みが発生する
+    g_use_tsc_deadline = SupportsTSCDeadline();
+    if (g_use_tsc_deadline) {
+        g_lvt_timer = kLVTTSCDeadline | InterruptVector::kLAPICTimer;
+        // LVTへの書き込みがWRMSRより先に完了することを保証する
+        __asm__ volatile("mfence" ::: "memory");
+    } else {
+        g_divide_config = 0b1011; // divide 1:1
+        g_lvt_timer = kLVTOneShot | InterruptVector::kLAPICTimer;
+    }
+    g_tsc_base = ReadTSC();
+
+    // 時刻情報ページはアプリから丸ごと見えるので、ほかのデータと同居しないよう専用のフレームを割り当てる
+    static_assert(sizeof(TimePage) <= kBytesPerFrame);
+    const auto frame = g_memory_manager->Allocate(1);
+    if (frame.error) {
+        Log(kError, "failed to allocate time page: %s\n", frame.error.Name());
+        exit(1);
+    }
+    g_time_page = reinterpret_cast<TimePage*>(frame.value.Frame());
+    memset(g_time_page, 0, kBytesPerFrame);
+    g_time_page->tsc_base = g_tsc_base;
+    g_time_page->tsc_freq = g_tsc_freq;
+    g_time_page->tick_freq = kTimerFreq;
 }
 
 void StartLAPICTimer() {
@@ -53,51 +122,294 @@ void StopLAPICTimer() {
     g_initial_count = 0;
 }
 
-Timer::Timer(unsigned long timeout, int value, uint64_t task_id) : timeout_{timeout}, value_{value}, task_id_{task_id} {
+Timer::Timer(unsigned long timeout, int value, uint64_t task_id, unsigned long period)
+    : timeout_{timeout}, value_{value}, task_id_{task_id}, period_{period} {
 }
 
-TimerManager::TimerManager() {
-    // 番兵
-    timers_.push(Timer{std::numeric_limits<unsigned long>::max(), 0, 0});
+TimerWheel::TimerWheel() {
+    for (auto& level : heads_) {
+        level.fill(kNil);
+    }
+    // 未使用のノードはnextで繋いでおく
+    for (uint16_t i = 0; i < kMaxTimers; i++) {
+        nodes_[i].next = i + 1 < kMaxTimers ? i + 1 : kNil;
+    }
+    free_head_ = 0;
 }
 
-bool TimerManager::Tick() {
-    tick_++;
+WithError<TimerHandle> TimerWheel::Add(const Timer& timer) {
+    if (free_head_ == kNil) {
+        return {0, MAKE_ERROR(Error::kFull)};
+    }
 
-    bool task_timer_timeout = false;
-    // タイムアウト処理
-    while (true) {
-        const auto& t = timers_.top();
-        // 先頭がまだタイムアウトしていない場合にループから抜ける
-        if (t.Timeout() > tick_) {
-            break;
-        }
+    const uint16_t i = free_head_;
+    free_head_ = nodes_[i].next;
+    auto& node = nodes_[i];
+    node.timer = timer;
+    node.in_use = true;
+    Link(i);
+    count_++;
 
-        if (t.Value() == kTaskTimerValue) {
-            task_timer_timeout = true;
-            timers_.pop();
-            timers_.push(Timer{tick_ + kTaskTimerPeriod, kTaskTimerValue, kMainTaskID});
-            continue;
-        }
+    const TimerHandle handle = static_cast<uint64_t>(node.generation) << 32 | (i + 1);
+    return {handle, MAKE_ERROR(Error::kSuccess)};
+}
+
+bool TimerWheel::Cancel(TimerHandle handle) {
+    const uint64_t i = (handle & 0xffffffffu) - 1;
+    const uint32_t generation = handle >> 32;
+    if (i >= kMaxTimers || !nodes_[i].in_use || nodes_[i].generation != generation) {
+        return false;
+    }
+
+    Unlink(i);
+    Free(i);
+    return true;
+}
+
+namespace {
+    /// 64bitのビット列を右にsビット回転
+    uint64_t RotateRight(uint64_t x, int s) {
+        return s == 0 ? x : (x >> s) | (x << (64 - s));
+    }
 
+    /// タイムアウトしたタイマの通知先に知らせる
+    void NotifyTimeout(const Timer& t) {
+        if (t.Value() == kTimerWakeup) {
+            if (Task* task = g_task_manager->FindTask(t.TaskID())) {
+                task->Wakeup();
+            }
+            return;
+        }
         Message msg{Message::kTimerTimeout};
         msg.arg.timer.timeout = t.Timeout();
         msg.arg.timer.value = t.Value();
         // タイマに記録されているタスクへタイムアウトを通知
-        g_task_manager->SendMessage(t.TaskID(), msg);
+        // 割り込み中なので、実行中のタスクを送信元として数えないよう直接キューに入れる
+        if (Task* task = g_task_manager->FindTask(t.TaskID())) {
+            task->SendMessage(msg);
+        }
+    }
+} // namespace
+
+unsigned long TimerWheel::NextEvent() const {
+    unsigned long next = kNoTimeout;
+
+    // 最下層の各スロットには、pending_から63ティック先までのタイマが1ティック刻みで並ぶ
+    if (const auto bits = RotateRight(occupied_[0], pending_ % kSlots); bits != 0) {
+        next = pending_ + __builtin_ctzll(bits);
+    }
+
+    // 上位の階層では、スロットの担当範囲の先頭時刻でカスケードが必要になる
+    for (int level = 1; level < kLevels; level++) {
+        const int shift = kSlotBits * level;
+        const unsigned long index = pending_ >> shift;
+        const int cur = index % kSlots;
+        // 担当範囲の先頭にいるなら現在位置のスロットは今処理すべきもの
+        // そうでなければ現在位置のスロットは一周先の範囲を表す
+        if ((pending_ & ((1ul << shift) - 1)) == 0 && (occupied_[level] >> cur) & 1) {
+            return pending_;
+        }
+        const auto bits = RotateRight(occupied_[level], (cur + 1) % kSlots);
+        if (bits == 0) {
+            continue;
+        }
+        const unsigned long event = (index + __builtin_ctzll(bits) + 1) << shift;
+        next = std::min(next, event);
+    }
+    return next;
+}
+
+void TimerWheel::Link(uint16_t i) {
+    auto& node = nodes_[i];
+
+    // どの階層に置くかは、pending_からの距離で決まる
+    // ホイールの範囲に収まらないほど先のタイマは、最上位階層の末尾に置き、カスケード時に置き直す
+    const unsigned long horizon = 1ul << (kSlotBits * kLevels);
+    unsigned long t = std::max(node.timer.Timeout(), pending_);
+    if (t - pending_ >= horizon) {
+        t = pending_ + horizon - 1;
+    }
+    const unsigned long delta = t - pending_;
+
+    int level = 0;
+    while (delta >= 1ul << (kSlotBits * (level + 1))) {
+        level++;
+    }
+    const int slot = (t >> (kSlotBits * level)) % kSlots;
 
-        timers_.pop();
+    auto& head = heads_[level][slot];
+    node.level = level;
+    node.slot = slot;
+    node.prev = kNil;
+    node.next = head;
+    if (head != kNil) {
+        nodes_[head].prev = i;
+    }
+    head = i;
+    occupied_[level] |= 1ull << slot;
+}
+
+void TimerWheel::Unlink(uint16_t i) {
+    auto& node = nodes_[i];
+    auto& head = heads_[node.level][node.slot];
+    if (node.prev != kNil) {
+        nodes_[node.prev].next = node.next;
+    } else {
+        head = node.next;
+    }
+    if (node.next != kNil) {
+        nodes_[node.next].prev = node.prev;
+    }
+    if (head == kNil) {
+        occupied_[node.level] &= ~(1ull << node.slot);
+    }
+}
+
+void TimerWheel::Free(uint16_t i) {
+    auto& node = nodes_[i];
+    node.in_use = false;
+    node.generation++;
+    node.next = free_head_;
+    free_head_ = i;
+    count_--;
+}
+
+void TimerWheel::Cascade() {
+    // 上の階層から順に移し替えることで、移した先のスロットも同じ時刻に処理できる
+    for (int level = kLevels - 1; level >= 1; level--) {
+        const int shift = kSlotBits * level;
+        if (pending_ & ((1ul << shift) - 1)) {
+            continue;
+        }
+
+        auto& head = heads_[level][(pending_ >> shift) % kSlots];
+        while (head != kNil) {
+            const uint16_t i = head;
+            Unlink(i);
+            Link(i);
+        }
+    }
+}
+
+void TimerWheel::Rearm(uint16_t i, unsigned long now) {
+    auto& timer = nodes_[i].timer;
+    // 前回のタイムアウト時刻を基準にするので、処理が遅れても周期がずれていかない
+    // 処理が遅れて過ぎてしまった周期は飛ばす
+    unsigned long next = timer.Timeout() + timer.Period();
+    if (next <= now) {
+        next += (now - next) / timer.Period() * timer.Period() + timer.Period();
+    }
+    timer.SetTimeout(next);
+    Link(i);
+}
+
+bool TimerManager::Tick() {
+    const auto now = CurrentTick();
+
+    // 読み出し側が書き換え途中の値を使わないよう、前後でシーケンスカウンタを増やす
+    g_time_page->seq++;
+    __asm__ volatile("" ::: "memory");
+    g_time_page->tick = now;
+    __asm__ volatile("" ::: "memory");
+    g_time_page->seq++;
+
+    // タイムアウト処理
+    wheel_.Advance(now, NotifyTimeout);
+
+    bool task_timer_timeout = false;
+    if (slice_timeout_ <= now) {
+        // 次のタイムスライスはタスク切り替え時に設定される
+        task_timer_timeout = true;
+        slice_timeout_ = kNoTimeout;
     }
 
+    Reprogram();
     return task_timer_timeout;
 }
 
-void TimerManager::AddTimer(const Timer& timer) {
-    timers_.push(timer);
+uint64_t NowNanoseconds() {
+    const uint64_t count = ReadTSC() - g_tsc_base;
+    // count * 10^9 はすぐに64bitを超えるので、秒の部分と秒未満の部分に分けて計算する
+    return count / g_tsc_freq * 1000000000 + count % g_tsc_freq * 1000000000 / g_tsc_freq;
+}
+
+unsigned long TimerManager::CurrentTick() const {
+    return (ReadTSC() - g_tsc_base) / g_tsc_per_tick;
+}
+
+WithError<TimerHandle> TimerManager::AddTimer(const Timer& timer) {
+    const auto now = CurrentTick();
+    if (timer.Timeout() <= now) {
+        // 既に過ぎた時刻のタイマをホイールに入れると次のティックまで遅れるので、この場でタイムアウトさせる
+        NotifyTimeout(timer);
+        if (timer.Period() == 0) {
+            return {0, MAKE_ERROR(Error::kSuccess)};
+        }
+        // 周期タイマは、過ぎてしまった周期を飛ばして登録する
+        Timer next = timer;
+        next.SetTimeout(timer.Timeout() + ((now - timer.Timeout()) / timer.Period() + 1) * timer.Period());
+        const auto handle = wheel_.Add(next);
+        Reprogram();
+        return handle;
+    }
+
+    const auto handle = wheel_.Add(timer);
+    Reprogram();
+    return handle;
+}
+
+bool TimerManager::CancelTimer(TimerHandle handle) {
+    const bool canceled = wheel_.Cancel(handle);
+    Reprogram();
+    return canceled;
+}
+
+void TimerManager::SetSliceTimer(unsigned long timeout) {
+    slice_timeout_ = timeout;
+    Reprogram();
+}
+
+void TimerManager::StopSliceTimer() {
+    slice_timeout_ = kNoTimeout;
+    Reprogram();
+}
+
+void TimerManager::Reprogram() {
+    const auto deadline = std::min(wheel_.NextEvent(), slice_timeout_);
+
+    if (g_use_tsc_deadline) {
+        // 0を書き込むとタイマが止まる
+        // 過去の時刻を書き込んだ場合は直ちに割り込みが発生する
+        uint64_t tsc = 0;
+        if (deadline != kNoTimeout) {
+            tsc = g_tsc_base + deadline * g_tsc_per_tick;
+        }
+        WriteMSR(kIA32_TSC_DEADLINE, tsc);
+        return;
+    }
+
+    if (deadline == kNoTimeout) {
+        StopLAPICTimer();
+        return;
+    }
+
+    // ワンショットモードでは残り時間をカウント数に換算する
+    // カウンタに収まらない場合は早めに割り込ませ、その時点で設定し直す
+    const auto now = CurrentTick();
+    const unsigned long remain = deadline > now ? deadline - now : 0;
+    uint64_t count = 1;
+    if (remain > kCountMax / g_lapic_per_tick) {
+        count = kCountMax;
+    } else if (remain > 0) {
+        count = remain * g_lapic_per_tick;
+    }
+    g_initial_count = count;
 }
 
 TimerManager* g_timer_manager;
+TimePage* g_time_page;
 unsigned long g_lapic_timer_freq;
+unsigned long g_tsc_freq;
 
 /// ctx_stack : 割り込みフレームの情報を使って構築したコンテキスト構造体）
 extern "C" void LAPICTimerOnInterrupt(const TaskContext& ctx_stack) {
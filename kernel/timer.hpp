@@ -4,64 +4,202 @@
 /// Local APICタイマ : Local APICのタイマ。CPUコア1つにつき1つのみ搭載。
 #pragma once
 
-#include "message.hpp"
+#include <array>
 #include <cstdint>
 #include <limits>
-#include <queue>
-#include <vector>
+
+#include "error.hpp"
+#include "message.hpp"
+#include "time_page.hpp"
 
 void InitializeLAPICTimer();
 void StartLAPICTimer();
 uint32_t LAPICTimerElapsed();
 void StopLAPICTimer();
 
+/// タイムアウトしない時刻
+constexpr unsigned long kNoTimeout = std::numeric_limits<unsigned long>::max();
+/// タイムアウト時にメッセージを送らず、タスクを起こすだけのタイマの値
+/// アプリが登録するタイマの値（負数）とは重ならない
+constexpr int kTimerWakeup = std::numeric_limits<int>::min();
+
 /// Local APICタイマの1カウントを基準とした、論理的なタイマ
 class Timer {
 public:
-    Timer(unsigned long timeout, int value, uint64_t task_id);
+    /// period : 0以外なら、タイムアウトするたびにperiodティック後に再設定される
+    Timer(unsigned long timeout, int value, uint64_t task_id, unsigned long period = 0);
     unsigned long Timeout() const { return timeout_; }
+    void SetTimeout(unsigned long timeout) { timeout_ = timeout; }
     int Value() const { return value_; }
     uint64_t TaskID() const { return task_id_; }
+    unsigned long Period() const { return period_; }
 
 private:
     /// タイムアウト時刻
-    /// TimeManager::tick_の値以下ならタイムアウトしたと見做す
+    /// TimeManager::CurrentTick()の値以下ならタイムアウトしたと見做す
     unsigned long timeout_;
     /// タイムアウト時に送信する値
     int value_;
     /// タイムアウトメッセージの通知先
     uint64_t task_id_;
+    /// 周期タイマの周期
+    unsigned long period_;
 };
 
-/// タイマー優先度を比較。タイムアウトが遠いほど優先度低
-inline bool operator<(const Timer& lhs, const Timer& rhs) {
-    return lhs.Timeout() > rhs.Timeout();
+/// 登録したタイマを識別する値。0は無効
+using TimerHandle = uint64_t;
+
+/// 階層型タイミングホイール
+/// 64スロットの輪を4階層重ねたもの。階層が1つ上がるごとに1スロットが受け持つ時間幅が64倍になる
+/// タイムアウトが近づくと上の階層から下の階層へ移し替え（カスケード）、最下層のスロットでタイムアウトさせる
+/// 追加・削除・タイムアウト処理はいずれも登録数によらず定数時間で、動的なメモリ確保もしない
+class TimerWheel {
+public:
+    static const int kSlotBits = 6;
+    static const int kSlots = 1 << kSlotBits;
+    static const int kLevels = 4;
+    /// 同時に登録できるタイマの数
+    static const size_t kMaxTimers = 256;
+
+    TimerWheel();
+    /// タイマを登録する。処理済みの時刻を指定した場合は、次に処理する時刻でタイムアウトする
+    WithError<TimerHandle> Add(const Timer& timer);
+    /// 登録を取り消す。既にタイムアウトした（あるいは無効な）ハンドル : false
+    bool Cancel(TimerHandle handle);
+    /// pred(timer)がtrueとなるタイマの登録をすべて取り消し、取り消した数を返す
+    template <class Pred>
+    size_t CancelIf(Pred pred);
+    /// 時刻nowまでに起きるべき処理をすべて行い、タイムアウトしたタイマごとにon_timeout(timer)をコールする
+    template <class F>
+    void Advance(unsigned long now, F on_timeout);
+    /// 次に処理が必要になる時刻（タイムアウトまたはカスケード）
+    /// 登録がなければkNoTimeout
+    unsigned long NextEvent() const;
+    size_t Count() const { return count_; }
+
+private:
+    static constexpr uint16_t kNil = 0xffff;
+    struct Node {
+        Timer timer{0, 0, 0};
+        /// 再利用されるたびに増やし、古いハンドルを無効にする
+        uint32_t generation{1};
+        bool in_use{false};
+        uint8_t level, slot;
+        uint16_t prev, next;
+    };
+
+    std::array<Node, kMaxTimers> nodes_{};
+    /// 各スロットに連なる双方向リストの先頭
+    std::array<std::array<uint16_t, kSlots>, kLevels> heads_{};
+    /// 空でないスロットのビットマップ
+    std::array<uint64_t, kLevels> occupied_{};
+    uint16_t free_head_;
+    size_t count_{0};
+    /// まだ処理していない最初の時刻
+    unsigned long pending_{0};
+
+    void Link(uint16_t i);
+    void Unlink(uint16_t i);
+    void Free(uint16_t i);
+    /// 時刻pending_で境界を迎える上位階層のスロットを下位階層に移し替える
+    void Cascade();
+    /// 周期タイマを、時刻nowより後の次の周期で登録し直す
+    void Rearm(uint16_t i, unsigned long now);
+};
+
+template <class Pred>
+size_t TimerWheel::CancelIf(Pred pred) {
+    size_t num_canceled = 0;
+    for (uint16_t i = 0; i < kMaxTimers; i++) {
+        if (nodes_[i].in_use && pred(nodes_[i].timer)) {
+            Unlink(i);
+            Free(i);
+            num_canceled++;
+        }
+    }
+    return num_canceled;
+}
+
+template <class F>
+void TimerWheel::Advance(unsigned long now, F on_timeout) {
+    while (pending_ <= now) {
+        // 何も起きない時刻は飛ばす
+        const auto next = NextEvent();
+        if (next > now) {
+            pending_ = now + 1;
+            break;
+        }
+        pending_ = next;
+        Cascade();
+
+        auto& head = heads_[0][pending_ % kSlots];
+        while (head != kNil) {
+            const uint16_t i = head;
+            const Timer timer = nodes_[i].timer;
+            Unlink(i);
+            if (timer.Period() > 0) {
+                Rearm(i, now);
+            } else {
+                Free(i);
+            }
+            on_timeout(timer);
+        }
+        pending_++;
+    }
 }
 
 /// タイマの割り込み回数を管理
+/// ワンショットで割り込みを設定し、次のタイムアウトまで割り込みを発生させない（ティックレス）
 class TimerManager {
 public:
-    TimerManager();
-    void AddTimer(const Timer& timer);
+    /// タイマを登録する
+    /// 現在のティック以前の時刻を指定したタイマは、この場でタイムアウトさせる（ワンショットならハンドルは0）
+    /// kTimerWakeup のタイマで眠るときは、登録した後に時刻を確かめてから眠ること
+    WithError<TimerHandle> AddTimer(const Timer& timer);
+    /// タイマの登録を取り消す。取り消せた : true
+    bool CancelTimer(TimerHandle handle);
+    /// pred(timer)がtrueとなるタイマの登録をすべて取り消す
+    template <class Pred>
+    size_t CancelTimersIf(Pred pred) {
+        const auto num_canceled = wheel_.CancelIf(pred);
+        Reprogram();
+        return num_canceled;
+    }
+    /// タイムアウトしたタイマを処理
     /// タスク切り替え用タイマがタイムアウト : true
     bool Tick();
-    unsigned long CurrentTick() const { return tick_; }
+    /// 起動からの経過ティック数（TSCから算出する）
+    unsigned long CurrentTick() const;
+    /// 実行中タスクのタイムスライスの終了時刻を設定
+    void SetSliceTimer(unsigned long timeout);
+    /// タイムスライスの計測を止める（ほかに実行可能なタスクがない場合）
+    void StopSliceTimer();
+    bool SliceTimerActive() const { return slice_timeout_ != kNoTimeout; }
+    /// 最も近いタイムアウト時刻にLocal APICタイマを設定し直す
+    /// 割り込み禁止状態でコールすること
+    void Reprogram();
 
 private:
-    // タイマ割り込み回数
-    volatile unsigned long tick_{0};
-    std::priority_queue<Timer> timers_{};
+    TimerWheel wheel_{};
+    /// タスク切り替えの時刻
+    unsigned long slice_timeout_{kNoTimeout};
 };
 
+/// 起動からの経過時間（ナノ秒）
+/// 校正済みのTSCから算出するので、ティックよりはるかに細かい分解能をもつ
+uint64_t NowNanoseconds();
+
 extern TimerManager* g_timer_manager;
+/// アプリと共有する時刻情報ページ（物理フレームを指す）
+extern TimePage* g_time_page;
 /// Local APICタイマの周波数（1秒あたりのカウント数）
 extern unsigned long g_lapic_timer_freq;
-/// 1秒間にTimerManager::Tick()をコールする回数
-const int kTimerFreq = 100;
+/// TSCの周波数（1秒あたりのカウント数）
+extern unsigned long g_tsc_freq;
+/// 1秒あたりのティック数（タイマの時間分解能）
+/// 割り込みは必要なときにしか発生しないので、分解能を上げても割り込み負荷は増えない
+const int kTimerFreq = 1000;
 
 /// タスク切り替え用タイマの周期
 /// 0.02secでタイムアウト
 const int kTaskTimerPeriod = static_cast<int>(kTimerFreq * 0.02);
-/// タスク切り替え用タイマの値（他のタイマとの識別用）
-/// 正の数値に修正（syscall.cpp::CreateTimer()を参照）
-const int kTaskTimerValue = std::numeric_limits<int>::max();
@@ -0,0 +1,24 @@
+#include "wait_queue.hpp"
+
+#include <algorithm>
+
+#include "task.hpp"
+
+void WaitQueue::Add(uint64_t task_id) {
+    if (std::find(waiters_.begin(), waiters_.end(), task_id) == waiters_.end()) {
+        waiters_.push_back(task_id);
+    }
+}
+
+void WaitQueue::Remove(uint64_t task_id) {
+    waiters_.erase(std::remove(waiters_.begin(), waiters_.end(), task_id), waiters_.end());
+}
+
+void WaitQueue::WakeAll() {
+    for (uint64_t task_id : waiters_) {
+        // 既に終了したタスクは kNoSuchTask となるので無視する
+        g_task_manager->Wakeup(task_id);
+    }
+    // 領域は解放しないので、割り込みハンドラからも呼び出せる
+    waiters_.clear();
+}
@@ -0,0 +1,23 @@
+/// 状態の変化を待つタスクの待機キュー
+
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+/// ファイルディスクリプタなどの状態が変わるのを待っているタスクの一覧
+/// タスクIDで記録するので、登録したまま終了したタスクがいても安全に起こせる
+/// 割り込みを禁止して操作すること
+class WaitQueue {
+public:
+    /// 登録する。既に登録されていれば何もしない
+    void Add(uint64_t task_id);
+    void Remove(uint64_t task_id);
+    /// 登録されているタスクをすべて起こし、登録を解除する
+    /// 割り込みハンドラからも呼び出せる
+    void WakeAll();
+    bool Empty() const { return waiters_.empty(); }
+
+private:
+    std::vector<uint64_t> waiters_{};
+};
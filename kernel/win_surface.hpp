@@ -0,0 +1,29 @@
+/// アプリのアドレス空間にマップしたウィンドウの描画領域
+/// アプリからも読み込まれる
+
+#pragma once
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/// 画素の形式（1画素4バイト）。最上位バイトは不透明度で、通常は 0xff にしておく
+/// メモリ上の並びが R, G, B, A
+#define WIN_SURFACE_RGB 0
+/// メモリ上の並びが B, G, R, A（uint32_t として読むと 0xAARRGGBB）
+#define WIN_SURFACE_BGR 1
+
+struct WinSurface {
+    /// ウィンドウの左上（枠を含む）の画素のアドレス
+    uint32_t* pixels;
+    /// ウィンドウの幅と高さ（画素）
+    int width, height;
+    /// 1行あたりの画素数（幅以上）
+    int stride;
+    /// WIN_SURFACE_RGB または WIN_SURFACE_BGR
+    int format;
+};
+
+#ifdef __cplusplus
+} // extern "C"
+#endif
@@ -43,11 +43,6 @@ namespace {
 } // namespace
 
 Window::Window(int width, int height, PixelFormat shadow_format) : width_{width}, height_{height} {
-    data_.resize(height);
-    for (int y = 0; y < height; y++) {
-        data_[y].resize(width);
-    }
-
     FrameBufferConfig fb_config{};
     fb_config.frame_buffer = nullptr;
     fb_config.horizontal_resolution = width;
@@ -60,50 +55,65 @@ Window::Window(int width, int height, PixelFormat shadow_format) : width_{width}
     }
 }
 
-void Window::DrawTo(FrameBuffer& dst, Vector2D<int> position, const Rectangle<int>& area) {
-    if (!transparent_color_) {
-        Rectangle<int> window_area{position, Size()};
-        // 重なり部分
-        Rectangle<int> intersection = area & window_area;
-        dst.Copy(intersection.pos, shadow_buffer_, {intersection.pos - position, intersection.size});
-        return;
-    }
-
-    const auto tc = transparent_color_.value();
-    auto& writer = dst.Writer();
-    // 条件式は、描画領域が画面端を超えた際に反対側から飛び出るのを防ぐのを意味する
-    for (int y = std::max(0, 0 - position.y);
-         y < std::min(Height(), writer.Height() - position.y);
-         y++) {
-        for (int x = std::max(0, 0 - position.x);
-             x < std::min(Width(), writer.Width() - position.x);
-             x++) {
-            const auto color = At(Vector2D<int>{x, y});
-            if (color != tc) {
-                writer.Write(position + Vector2D<int>{x, y}, color);
-            }
-        }
+void Window::DrawTo(FrameBuffer& dst, Vector2D<int> position, const Rectangle<int>& area, uint8_t opacity) {
+    Rectangle<int> window_area{position, Size()};
+    // 重なり部分
+    Rectangle<int> intersection = area & window_area;
+    const Rectangle<int> src_area{intersection.pos - position, intersection.size};
+    if (transparent_color_) {
+        // 透過色の画素を飛ばしながら、描画領域から直接コピーする
+        dst.CopyTransparent(intersection.pos, shadow_buffer_, src_area, transparent_color_.value());
+    } else if (!alpha_ && opacity == 255) {
+        // 不透明なウィンドウは重ね合わせの計算をせずにそのまま写す
+        dst.Copy(intersection.pos, shadow_buffer_, src_area);
+    } else {
+        dst.Blend(intersection.pos, shadow_buffer_, src_area, opacity, alpha_);
     }
 }
 
 void Window::SetTransparentColor(std::optional<PixelColor> color) {
     transparent_color_ = color;
 }
+
+void Window::SetAlpha(bool alpha) {
+    alpha_ = alpha;
+}
 /// このインスタンスに紐付いたWindowWriterを取得
 Window::WindowWriter* Window::Writer() {
     return &writer_;
 }
 
 /// 指定した位置のピクセルを返す
-const PixelColor& Window::At(Vector2D<int> pos) const {
-    return data_[pos.y][pos.x];
+PixelColor Window::At(Vector2D<int> pos) const {
+    return shadow_buffer_.Decode(*shadow_buffer_.PixelAt(pos));
 }
 
 void Window::Write(Vector2D<int> pos, PixelColor color) {
-    data_[pos.y][pos.x] = color;
     shadow_buffer_.Writer().Write(pos, color);
 }
 
+void Window::BlitRect(Vector2D<int> pos, Vector2D<int> size, const uint32_t* pixels, int stride) {
+    auto& writer = shadow_buffer_.Writer();
+    if (alpha_) {
+        writer.BlitRect(pos, size, pixels, stride);
+        return;
+    }
+
+    // アプリは 0x00RRGGBB 形式で渡してくるので、描画領域にアルファ値0のまま残さないよう不透明にする
+    const int kChunk = 256;
+    uint32_t row[kChunk];
+    for (int y = 0; y < size.y; y++) {
+        for (int x = 0; x < size.x; x += kChunk) {
+            const int n = std::min(kChunk, size.x - x);
+            const uint32_t* src = &pixels[y * stride + x];
+            for (int i = 0; i < n; i++) {
+                row[i] = src[i] | 0xff000000;
+            }
+            writer.BlitRect(pos + Vector2D<int>{x, y}, {n, 1}, row, n);
+        }
+    }
+}
+
 int Window::Width() const {
     return width_;
 }
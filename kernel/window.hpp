@@ -30,6 +30,20 @@ public:
         virtual int Width() const override { return window_.Width(); }
         virtual int Height() const override { return window_.Height(); }
 
+        // まとめて描く処理は、描画領域の画素形式に特殊化した書き込みにそのまま任せる
+        virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& color) override {
+            window_.shadow_buffer_.Writer().FillSpan(pos, len, color);
+        }
+        virtual void FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& color) override {
+            window_.shadow_buffer_.Writer().FillRect(pos, size, color);
+        }
+        virtual void BlitRect(Vector2D<int> pos, Vector2D<int> size, const uint32_t* pixels, int stride) override {
+            window_.BlitRect(pos, size, pixels, stride);
+        }
+        virtual void WriteMaskedRow(Vector2D<int> pos, const uint8_t* mask, int width, const PixelColor& color) override {
+            window_.shadow_buffer_.Writer().WriteMaskedRow(pos, mask, width, color);
+        }
+
     private:
         Window& window_;
     };
@@ -44,15 +58,27 @@ public:
     /// dst : 描画先
     /// position : dstの左上を基準としたウィンドウ位置
     /// area : dstの左上の基準とた描画対象範囲
-    void DrawTo(FrameBuffer& dst, Vector2D<int> position, const Rectangle<int>& area);
+    /// opacity : ウィンドウ全体の不透明度（255 なら不透明。透過色を使うウィンドウでは無視する）
+    void DrawTo(FrameBuffer& dst, Vector2D<int> position, const Rectangle<int>& area, uint8_t opacity = 255);
     void SetTransparentColor(std::optional<PixelColor> color);
+    /// true にすると、画素ごとのアルファ値（PixelColor::a）を使って下の層と重ねる
+    /// 描画領域の初期状態は完全に透明
+    void SetAlpha(bool alpha);
+    /// 下の層を完全に覆い隠す -> true
+    bool IsOpaque() const { return !alpha_ && !transparent_color_; }
     /// このインスタンスに紐付いたWindowWriterを取得
     WindowWriter* Writer();
+    /// 描画内容を保持するバッファ。先頭は4KiB境界で、大きさは BufferBytes()
+    /// アプリのアドレス空間にマップして、直接書き込ませるときに使う
+    const FrameBuffer& Surface() const { return shadow_buffer_; }
 
-    /// 指定した位置のピクセルを返す
-    const PixelColor& At(Vector2D<int> pos) const;
+    /// 指定した位置のピクセルを返す（描画領域の画素形式から戻す）
+    PixelColor At(Vector2D<int> pos) const;
 
     void Write(Vector2D<int> pos, PixelColor color);
+    /// 0xAARRGGBB 形式の画素を並べた配列を矩形に描く
+    /// アルファ値を使わないウィンドウでは AA を無視し、不透明（0xff）として書き込む
+    void BlitRect(Vector2D<int> pos, Vector2D<int> size, const uint32_t* pixels, int stride);
 
     int Width() const;
     int Height() const;
@@ -70,11 +96,13 @@ public:
 
 private:
     int width_, height_;
-    std::vector<std::vector<PixelColor>> data_{};
     WindowWriter writer_{*this};
     /// 透過色
     std::optional<PixelColor> transparent_color_{std::nullopt};
+    /// 画素ごとのアルファ値を使う -> true
+    bool alpha_{false};
 
+    /// 描画領域。フレームバッファと同じ画素形式で、行の先頭を揃えた1つの連続した領域
     /// 本命のメモリ領域には最適化されたmemcpyで後で一気に書き込む
     FrameBuffer shadow_buffer_{};
 };
@@ -101,6 +129,18 @@ public:
         virtual int Height() const override {
             return window_.Height() - kTopLeftMargin.y - kBottomRightMargin.y;
         }
+        virtual void FillSpan(Vector2D<int> pos, int len, const PixelColor& color) override {
+            window_.Writer()->FillSpan(pos + kTopLeftMargin, len, color);
+        }
+        virtual void FillRect(Vector2D<int> pos, Vector2D<int> size, const PixelColor& color) override {
+            window_.Writer()->FillRect(pos + kTopLeftMargin, size, color);
+        }
+        virtual void BlitRect(Vector2D<int> pos, Vector2D<int> size, const uint32_t* pixels, int stride) override {
+            window_.Writer()->BlitRect(pos + kTopLeftMargin, size, pixels, stride);
+        }
+        virtual void WriteMaskedRow(Vector2D<int> pos, const uint8_t* mask, int width, const PixelColor& color) override {
+            window_.Writer()->WriteMaskedRow(pos + kTopLeftMargin, mask, width, color);
+        }
 
     private:
         TopLevelWindow& window_;
@@ -0,0 +1,65 @@
+#include "workqueue.hpp"
+
+#include <array>
+
+#include "message_queue.hpp"
+#include "task.hpp"
+
+namespace {
+    struct WorkItem {
+        WorkFunc* func;
+        uint64_t arg;
+    };
+
+    /// 優先度ごとに保持できる作業項目の数（2の累乗）
+    const size_t kWorkQueueSize = 64;
+    const size_t kNumWorkPriorities = 3;
+
+    /// 各優先度のワーカタスクが動作するタスクのレベル
+    const std::array<int, kNumWorkPriorities> kWorkerLevel = {1, 2, 3};
+    const std::array<const char*, kNumWorkPriorities> kWorkerName = {"work-lo", "work-nm", "work-hi"};
+
+    std::array<MPSCQueue<WorkItem, kWorkQueueSize>, kNumWorkPriorities>* g_work_queues;
+    std::array<Task*, kNumWorkPriorities> g_workers;
+
+    /// 依頼された作業を順に実行し、なくなったら眠る
+    void TaskWorker(uint64_t task_id, int64_t data) {
+        auto& queue = (*g_work_queues)[data];
+        Task& task = *g_workers[data];
+        while (true) {
+            __asm__("cli");
+            auto item = queue.Pop();
+            if (!item) {
+                task.Sleep();
+                __asm__("sti");
+                continue;
+            }
+            __asm__("sti");
+
+            item->func(item->arg);
+        }
+    }
+} // namespace
+
+Error QueueWork(WorkFunc* func, uint64_t arg, WorkPriority priority) {
+    const auto i = static_cast<size_t>(priority);
+    if (!(*g_work_queues)[i].Push(WorkItem{func, arg})) {
+        return MAKE_ERROR(Error::kFull);
+    }
+    g_workers[i]->Wakeup();
+    return MAKE_ERROR(Error::kSuccess);
+}
+
+void InitializeWorkQueue() {
+    g_work_queues = new std::array<MPSCQueue<WorkItem, kWorkQueueSize>, kNumWorkPriorities>;
+
+    __asm__("cli");
+    for (size_t i = 0; i < kNumWorkPriorities; i++) {
+        Task& worker = g_task_manager->NewTask()
+                           .InitContext(TaskWorker, i)
+                           .SetName(kWorkerName[i]);
+        g_workers[i] = &worker;
+        g_task_manager->Wakeup(&worker, kWorkerLevel[i]);
+    }
+    __asm__("sti");
+}
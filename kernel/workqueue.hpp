@@ -0,0 +1,25 @@
+/// 割り込みハンドラの後半処理などを専用のワーカタスクで実行する仕組み
+
+#pragma once
+
+#include <cstdint>
+
+#include "error.hpp"
+
+/// 作業の優先度。高いものほど優先度の高いワーカタスクで実行される
+enum class WorkPriority {
+    kLow,
+    kNormal,
+    kHigh,
+};
+
+/// ワーカタスクで実行する関数
+using WorkFunc = void(uint64_t arg);
+
+/// 作業をワーカタスクに依頼する
+/// 割り込みハンドラからも呼び出せる。タスクから呼び出す場合は割り込みを禁止しておくこと
+/// 作業項目の領域はあらかじめ確保しておき、空きがなければ依頼を捨てて kFull を返す
+Error QueueWork(WorkFunc* func, uint64_t arg, WorkPriority priority = WorkPriority::kNormal);
+
+/// 優先度ごとのワーカタスクを起動する
+void InitializeWorkQueue();